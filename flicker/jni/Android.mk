@@ -12,7 +12,17 @@ INC_CFLAGS=$(LOCAL_PATH)/main $(LOCAL_PATH)/ioctl $(LOCAL_PATH)/utils $(LOCAL_PA
 LOCAL_C_INCLUDES := $(INC_CFLAGS)
 LOCAL_SRC_FILES += $(PWD)/$(LOCAL_PATH)/main/vd628x_fft_utils.c
 LOCAL_SRC_FILES += $(PWD)/$(LOCAL_PATH)/fft/fft-dit.c
+LOCAL_SRC_FILES += $(PWD)/$(LOCAL_PATH)/fft/fft-real.c
+LOCAL_SRC_FILES += $(PWD)/$(LOCAL_PATH)/fft/fft-band.c
+LOCAL_SRC_FILES += $(PWD)/$(LOCAL_PATH)/fft/fft-stockham.c
+LOCAL_SRC_FILES += $(PWD)/$(LOCAL_PATH)/fft/fft-simd.c
+LOCAL_SRC_FILES += $(PWD)/$(LOCAL_PATH)/fft/fft-q15.c
+LOCAL_SRC_FILES += $(PWD)/$(LOCAL_PATH)/main/vd628x_ring.c
+LOCAL_SRC_FILES += $(PWD)/$(LOCAL_PATH)/main/vd628x_backend_kernel.c
+LOCAL_SRC_FILES += $(PWD)/$(LOCAL_PATH)/main/vd628x_backend_host.c
 LOCAL_SRC_FILES += $(PWD)/$(LOCAL_PATH)/main/vd628x_platform.c
+LOCAL_SRC_FILES += $(PWD)/$(LOCAL_PATH)/main/vd628x_clock_sync.c
+LOCAL_SRC_FILES += $(PWD)/$(LOCAL_PATH)/main/vd628x_recorder.c
 LOCAL_SRC_FILES += $(PWD)/$(LOCAL_PATH)/main/vd628x_flk_detect.c
 LOCAL_SRC_FILES += $(PWD)/$(LOCAL_PATH)/main/vd628x_main.cpp
 $(warning Compiling $(LOCAL_SRC_FILES))
@@ -22,10 +32,32 @@ LOCAL_CFLAGS := -Wall -Wextra
 #LOCAL_CFLAGS += -DVD6282
 LOCAL_CFLAGS += -DVD6283
 LOCAL_CFLAGS += -DLOCALLY_MEASURED_SPI_FREQUENCY
+# number of 1 second sample buffers of the capture ring (3 by default, 2 min)
+#LOCAL_CFLAGS += -DPLATFORM_BUFFERS_NB=3
+# max number of chunks per spi transfer when the driver supports batched transfers (16 by default)
+#LOCAL_CFLAGS += -DPLATFORM_BATCH_CHUNKS=16
+# time without spi chunk after which the bus is reported as stalled (1000 ms by default)
+#LOCAL_CFLAGS += -DPLATFORM_STALL_TIMEOUT_MS=1000
+# flicker channel without the sensor : samples of a file, or synthetic flicker of 100 Hz
+#LOCAL_CFLAGS += -DPLATFORM_SPI_DEVICE=\"file:/data/local/tmp/vd628x_samples.raw\"
+#LOCAL_CFLAGS += -DPLATFORM_SPI_DEVICE=\"synthetic:100\"
+# directory of the recordings of the flicker channel (RecordSamples configuration)
+#LOCAL_CFLAGS += -DPLATFORM_RECORD_DIR=\"/data/local/tmp\"
+
+# ** fft **
+LOCAL_CFLAGS += -DFFT_REAL_INPUT
+LOCAL_CFLAGS += -DFFT_STOCKHAM
+LOCAL_CFLAGS += -DFFT_SIMD
+# neon stage kernel on arm64-v8a, once vd628x_fft_simd_check passes on the target
+#LOCAL_CFLAGS += -DFFT_NEON
+#LOCAL_CFLAGS += -DFFT_FIXED_POINT
+# number of peaks averaged into avgFlickerFreqAmplitude (5 by default, 16 max)
+#LOCAL_CFLAGS += -DFLK_PEAKS_NB=5
 
 # ** debug & traces **
 #LOCAL_CFLAGS += -DLOG_FFT
 #LOCAL_CFLAGS += -DLOG_SAMPLES
+#LOCAL_CFLAGS += -DFFT_REAL_INPUT_CHECK
 
 # ** module **
 LOCAL_MODULE:= vd628x_flicker
@@ -48,3 +80,49 @@ LOCAL_LDLIBS:=-llog
 # ** module **
 LOCAL_MODULE:= vd628x_flicker_detect_testapp
 include $(BUILD_EXECUTABLE)
+
+# ******** fft stage kernels check ********
+# checks the vector kernels of fft-simd.c against the scalar one and times them
+# adb push libs/arm64-v8a/vd628x_fft_simd_check /data/local/tmp, then run it there
+include $(CLEAR_VARS)
+INC_CFLAGS=$(LOCAL_PATH)/fft
+LOCAL_C_INCLUDES := $(INC_CFLAGS)
+LOCAL_SRC_FILES := $(PWD)/$(LOCAL_PATH)/test/vd628x_fft_simd_check.c
+LOCAL_SRC_FILES += $(PWD)/$(LOCAL_PATH)/fft/fft-simd.c
+LOCAL_SRC_FILES += $(PWD)/$(LOCAL_PATH)/fft/fft-stockham.c
+$(warning Compiling $(LOCAL_SRC_FILES))
+
+# ** flags **
+# timed with optimizations, whatever APP_OPTIM
+LOCAL_CFLAGS := -Wall -Wextra -O2
+LOCAL_CFLAGS += -DFFT_SIMD
+# the neon kernel is checked even though the library does not select it yet
+LOCAL_CFLAGS += -DFFT_NEON
+
+# ** module **
+LOCAL_MODULE:= vd628x_fft_simd_check
+include $(BUILD_EXECUTABLE)
+
+# ******** real input fft check ********
+# checks fft_real_execute and fft_real_execute_pruned against fft()
+# adb push libs/arm64-v8a/vd628x_fft_real_check /data/local/tmp, then run it there
+include $(CLEAR_VARS)
+INC_CFLAGS=$(LOCAL_PATH)/fft
+LOCAL_C_INCLUDES := $(INC_CFLAGS)
+LOCAL_SRC_FILES := $(PWD)/$(LOCAL_PATH)/test/vd628x_fft_real_check.c
+LOCAL_SRC_FILES += $(PWD)/$(LOCAL_PATH)/fft/fft-dit.c
+LOCAL_SRC_FILES += $(PWD)/$(LOCAL_PATH)/fft/fft-real.c
+LOCAL_SRC_FILES += $(PWD)/$(LOCAL_PATH)/fft/fft-band.c
+LOCAL_SRC_FILES += $(PWD)/$(LOCAL_PATH)/fft/fft-stockham.c
+LOCAL_SRC_FILES += $(PWD)/$(LOCAL_PATH)/fft/fft-simd.c
+$(warning Compiling $(LOCAL_SRC_FILES))
+
+# ** flags **
+# the fft engine of the library
+LOCAL_CFLAGS := -Wall -Wextra -O2
+LOCAL_CFLAGS += -DFFT_STOCKHAM
+LOCAL_CFLAGS += -DFFT_SIMD
+
+# ** module **
+LOCAL_MODULE:= vd628x_fft_real_check
+include $(BUILD_EXECUTABLE)
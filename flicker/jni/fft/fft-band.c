@@ -0,0 +1,60 @@
+#include "fft.h"
+
+#define DFT_BINS 4
+
+/*
+ * Direct evaluation of a few bins of the N points DFT of a real signal
+ *   X[k] = sum_n x[n] * W_N^(n*k)
+ * W_N^m is read from the plan twiddles, which only hold m < N/2 :
+ * W_N^(m+N/2) = -W_N^m, so the sample is negated in the second half turn.
+ */
+int fft_dft_real_bins(const struct fft_plan *plan, const float *x, size_t n_valid, float complex *out, size_t k_first, size_t k_last)
+{
+	if( !plan || plan->N < 2 || k_first > k_last || k_last >= plan->N || n_valid > plan->N ) return 1;
+
+	size_t N = plan->N;
+	unsigned shift = plan->log2N - 1;
+
+	// DFT_BINS bins per pass over the samples : independent accumulators
+	// hide the latency of the additions and each sample is loaded once
+	for(size_t k0 = k_first; k0 <= k_last; k0 += DFT_BINS) {
+		float re[DFT_BINS] = { 0 };
+		float im[DFT_BINS] = { 0 };
+		size_t m[DFT_BINS] = { 0 };
+		size_t nb = k_last - k0 + 1 < DFT_BINS ? k_last - k0 + 1 : DFT_BINS;
+
+		for(size_t n = 0; n < n_valid; n++) {
+			for(size_t b = 0; b < DFT_BINS; b++) {
+				float complex w = plan->twiddles[m[b] & (N/2-1)];
+				float xs = x[n] * (1.0f - 2.0f * (float)(m[b] >> shift));
+
+				re[b] += xs * crealf(w);
+				im[b] += xs * cimagf(w);
+				m[b] = (m[b] + k0 + b) & (N-1);
+			}
+		}
+
+		for(size_t b = 0; b < nb; b++)
+			out[k0 + b] = re[b] + I*im[b];
+	}
+
+	return 0;
+}
+
+/*
+ * Cost model calibrated on the float engines : the vectorized real input FFT
+ * of N samples costs about as much as the direct evaluation (scalar, twiddle
+ * gather) of log2(N/2)/8 bins over N samples, i.e. 1 to 2 bins for 512 to
+ * 4096 points. The DFT only pays for the valid samples, so it gets more
+ * attractive during the zero padded captures.
+ */
+int fft_dft_is_cheaper(size_t N, size_t n_valid, size_t bins)
+{
+	size_t log2N = 0;
+
+	while( ((size_t)1 << log2N) < N ) log2N++;
+
+	if( log2N < 2 ) return 1;
+
+	return 8 * bins * n_valid <= N * (log2N - 1);
+}
@@ -23,11 +23,13 @@ static void nop_split(const float complex *x, float complex *X, size_t N)
 	}
 }
 
-static void fft_split(const float complex *x, float complex *X, size_t N, float complex phi)
+static void fft_split(const float complex *x, float complex *X, size_t N, float complex w)
 {
 	for(size_t n = 0; n < N/2; n++) {
-		X[0/2+n] = x[2*n+0] + x[2*n+1] * cexp(-2*(float)M_PI*I*phi);
-		X[N/2+n] = x[2*n+0] - x[2*n+1] * cexp(-2*(float)M_PI*I*phi);
+		float complex t = x[2*n+1] * w;
+
+		X[0/2+n] = x[2*n+0] + t;
+		X[N/2+n] = x[2*n+0] - t;
 	}
 }
 
@@ -57,44 +59,124 @@ static int nop_reverse(int b, float complex *buffers[2], size_t N)
 	return b;
 }
 
-static int fft_reverse(int b, float complex *buffers[2], size_t N)
+static int fft_reverse(int b, float complex *buffers[2], const struct fft_plan *plan)
 {
-	int J = ctz(N);
+	size_t N = plan->N;
 
-	for(int j = 0; j < J; j++, b++) {
+	for(int j = 0; j < plan->log2N; j++, b++) {
 		size_t delta = N>>j;
 
+		// block n/delta uses W_N^revbits(n/delta, j)<<(J-1-j), which is the
+		// (J-1)-bit reversal of the block index stored in the plan
 		for(size_t n = 0; n < N; n += delta) {
-			float complex phi = (float)revbits( n/delta, j) / (float)(2<<j);
-			fft_split(buffers[b&1]+n, buffers[~b&1]+n, delta, phi);
+			fft_split(buffers[b&1]+n, buffers[~b&1]+n, delta, plan->twiddles[plan->rev[n/delta]]);
 		}
 	}
 
 	return b;
 }
 
-//int fft(float complex *vector, size_t N)
-int fft(float complex *vector, float complex *out, size_t N)
+static const struct fft_plan *plans[FFT_PLAN_MAX_LOG2+1];
+
+static void fft_plan_free(struct fft_plan *plan)
 {
-	if( !N ) return 0;
+	if( !plan ) return;
 
-	if( N & (N-1) ) return 1;
+	free(plan->twiddles);
+	free(plan->rev);
+	free(plan);
+}
+
+const struct fft_plan *fft_plan_create(size_t N)
+{
+	if( !N || (N & (N-1)) ) return NULL;
+
+	int J = ctz(N);
+
+	if( J > FFT_PLAN_MAX_LOG2 ) return NULL;
+
+	if( plans[J] ) return plans[J];
+
+	struct fft_plan *plan = calloc(1, sizeof(struct fft_plan));
+
+	if( !plan ) return NULL;
+
+	plan->N = N;
+	plan->log2N = J;
+	plan->twiddles = malloc((N/2 ? N/2 : 1) * sizeof(float complex));
+	plan->rev = malloc((N/2 ? N/2 : 1) * sizeof(uint16_t));
+
+	if( !plan->twiddles || !plan->rev ) {
+		fft_plan_free(plan);
+		return NULL;
+	}
+
+	for(size_t k = 0; k < N/2; k++) {
+		plan->twiddles[k] = (float complex)cexp(-2*M_PI*I*(double)k/(double)N);
+		plan->rev[k] = (uint16_t)revbits(k, J-1);
+	}
+
+	plans[J] = plan;
 
-	float complex *buffers[2] = { vector, out };
+	return plan;
+}
+
+void fft_plan_cleanup(void)
+{
+	for(int j = 0; j <= FFT_PLAN_MAX_LOG2; j++) {
+		fft_plan_free((struct fft_plan *)plans[j]);
+		plans[j] = NULL;
+	}
+}
+
+int fft_dit_execute(const struct fft_plan *plan, float complex *in, float complex *out)
+{
+	if( !plan ) return 1;
+
+	float complex *buffers[2] = { in, out };
 
 	if( !buffers[1] ) return -1;
 
 	int b = 0;
 
-	b = nop_reverse(b, buffers, N);
-	b = fft_reverse(b, buffers, N);
-	b = nop_reverse(b, buffers, N);
-
-	//memmove(vector, buffers[b&1], N*sizeof(float complex));
+	b = nop_reverse(b, buffers, plan->N);
+	b = fft_reverse(b, buffers, plan);
+	b = nop_reverse(b, buffers, plan->N);
 
-	//free( buffers[1] );
+	// the result lands in buffers[b&1] depending on the parity of log2(N)
+	if( buffers[b&1] != out )
+		memcpy(out, buffers[b&1], plan->N*sizeof(float complex));
 
 	return 0;
 }
 
+int fft_execute(const struct fft_plan *plan, float complex *in, float complex *out)
+{
+#ifdef FFT_STOCKHAM
+	return fft_stockham_execute(plan, in, out);
+#else
+	return fft_dit_execute(plan, in, out);
+#endif
+}
 
+int fft_execute_pruned(const struct fft_plan *plan, float complex *in, float complex *out, size_t n_valid)
+{
+#ifdef FFT_STOCKHAM
+	return fft_stockham_execute_pruned(plan, in, out, n_valid);
+#else
+	// no pruning in this engine : clear the tail and run the full transform
+	if( plan && n_valid < plan->N )
+		memset(in + n_valid, 0, (plan->N - n_valid)*sizeof(float complex));
+
+	return fft_dit_execute(plan, in, out);
+#endif
+}
+
+int fft(float complex *vector, float complex *out, size_t N)
+{
+	if( !N ) return 0;
+
+	if( N & (N-1) ) return 1;
+
+	return fft_execute(fft_plan_create(N), vector, out);
+}
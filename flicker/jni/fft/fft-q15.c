@@ -0,0 +1,220 @@
+#include "fft-q15.h"
+#include "fft.h"
+#include <math.h>
+#include <stdlib.h>
+
+// twiddles W_N^k for k < N/2, interleaved real and imaginary parts in Q15
+static int16_t *twiddles[FFT_PLAN_MAX_LOG2+1];
+
+static int ctz(size_t N)
+{
+	int ctz1 = 0;
+
+	while( N ) {
+		ctz1++;
+		N >>= 1;
+	}
+
+	return ctz1-1;
+}
+
+static int16_t q15(double v)
+{
+	long r = lround(v * 32768.0);
+
+	if( r > INT16_MAX ) return INT16_MAX;
+	if( r < INT16_MIN ) return INT16_MIN;
+
+	return (int16_t)r;
+}
+
+int fft_q15_prepare(size_t N)
+{
+	if( N < 4 || (N & (N-1)) ) return 1;
+
+	int J = ctz(N);
+
+	if( J > FFT_PLAN_MAX_LOG2 ) return 1;
+
+	if( twiddles[J] ) return 0;
+
+	int16_t *w = malloc(N * sizeof(int16_t));
+
+	if( !w ) return -1;
+
+	for(size_t k = 0; k < N/2; k++) {
+		w[2*k+0] = q15(cos(2*M_PI*(double)k/(double)N));
+		w[2*k+1] = q15(-sin(2*M_PI*(double)k/(double)N));
+	}
+
+	twiddles[J] = w;
+
+	return 0;
+}
+
+void fft_q15_cleanup(void)
+{
+	for(int j = 0; j <= FFT_PLAN_MAX_LOG2; j++) {
+		free(twiddles[j]);
+		twiddles[j] = NULL;
+	}
+}
+
+static int32_t max_abs(const int16_t *x, size_t n)
+{
+	int32_t m = 0;
+
+	for(size_t i = 0; i < n; i++) {
+		int32_t v = x[i] < 0 ? -(int32_t)x[i] : x[i];
+
+		if( v > m )
+			m = v;
+	}
+
+	return m;
+}
+
+/*
+ * A radix-2 butterfly (or the real split) grows a component by at most
+ * 1 + sqrt(2). Shift right by just enough to keep the outputs in Q15.
+ */
+static int stage_shift(int32_t peak)
+{
+	if( peak <= 13572 ) return 0;
+	if( peak <= 27145 ) return 1;
+
+	return 2;
+}
+
+// store v in Q15 and keep track of the block peak for the next stage
+static inline int16_t store16(int32_t v, int32_t *peak)
+{
+	if( v > INT16_MAX ) v = INT16_MAX;
+	if( v < INT16_MIN ) v = INT16_MIN;
+
+	if( v > *peak ) *peak = v;
+	if( -v > *peak ) *peak = -v;
+
+	return (int16_t)v;
+}
+
+// (re + i*im) * (wr + i*wi), Q15 x Q15 accumulated in Q31, rounded back to Q15.
+// |re + i*im| <= 2^15*sqrt(2) so the Q31 sums can not overflow
+static inline void cmul_q15(int32_t re, int32_t im, int32_t wr, int32_t wi, int32_t *out_re, int32_t *out_im)
+{
+	*out_re = (re * wr - im * wi + (1 << 14)) >> 15;
+	*out_im = (re * wi + im * wr + (1 << 14)) >> 15;
+}
+
+// same with 17 bit inputs, accumulated on 64 bits
+static inline void cmul_q16(int32_t re, int32_t im, int32_t wr, int32_t wi, int32_t *out_re, int32_t *out_im)
+{
+	*out_re = (int32_t)(((int64_t)re * wr - (int64_t)im * wi + (1 << 14)) >> 15);
+	*out_im = (int32_t)(((int64_t)re * wi + (int64_t)im * wr + (1 << 14)) >> 15);
+}
+
+static void bit_reverse(int16_t *z, size_t M)
+{
+	for(size_t i = 0, j = 0; i < M; i++) {
+		if( i < j ) {
+			int16_t re = z[2*i], im = z[2*i+1];
+
+			z[2*i] = z[2*j];
+			z[2*i+1] = z[2*j+1];
+			z[2*j] = re;
+			z[2*j+1] = im;
+		}
+
+		size_t bit = M >> 1;
+
+		while( j & bit ) {
+			j ^= bit;
+			bit >>= 1;
+		}
+		j |= bit;
+	}
+}
+
+int fft_q15_real(int16_t *data, size_t N, int *exponent)
+{
+	if( N < 4 || (N & (N-1)) ) return 1;
+
+	int J = ctz(N);
+
+	if( J > FFT_PLAN_MAX_LOG2 || !twiddles[J] ) return 1;
+
+	const int16_t *w = twiddles[J];
+	size_t M = N/2;
+	int e = 0;
+
+	// normalize the input so that the block uses the Q15 range (peak below 2^14)
+	int32_t peak = max_abs(data, N);
+
+	if( peak ) {
+		while( peak < (1 << 13) ) {
+			peak <<= 1;
+			e--;
+		}
+		for(size_t i = 0; i < N; i++)
+			data[i] = (int16_t)(data[i] * (1 << -e));
+	}
+
+	bit_reverse(data, M);
+
+	// decimation in time stages. W_M^(k) = W_N^(2k)
+	for(size_t half = 1; half < M; half *= 2) {
+		int shift = stage_shift(peak);
+		size_t tw_step = N / (2*half);
+
+		e += shift;
+		peak = 0;
+
+		for(size_t n = 0; n < M; n += 2*half) {
+			for(size_t k = 0; k < half; k++) {
+				int16_t *a = &data[2*(n+k)];
+				int16_t *b = &data[2*(n+k+half)];
+				int32_t ar = a[0], ai = a[1];
+				int32_t tr, ti;
+
+				cmul_q15(b[0], b[1], w[2*k*tw_step], w[2*k*tw_step+1], &tr, &ti);
+
+				a[0] = store16((ar + tr) >> shift, &peak);
+				a[1] = store16((ai + ti) >> shift, &peak);
+				b[0] = store16((ar - tr) >> shift, &peak);
+				b[1] = store16((ai - ti) >> shift, &peak);
+			}
+		}
+	}
+
+	// real split, in place on bins k and M-k (see fft-real.c)
+	int shift = stage_shift(peak);
+
+	e += shift;
+
+	int32_t z0r = data[0], z0i = data[1];
+
+	data[0] = store16((z0r + z0i) >> shift, &peak);
+	data[1] = 0;
+
+	for(size_t k = 1; k <= M/2; k++) {
+		int32_t ar = data[2*k], ai = data[2*k+1];
+		int32_t br = data[2*(M-k)], bi = -data[2*(M-k)+1];
+		// e = (a + b)/2 and o = -i*(a - b)/2, kept with one more bit (x2)
+		int32_t er = ar + br, ei = ai + bi;
+		int32_t or_ = ai - bi, oi = br - ar;
+		int32_t tr, ti;
+
+		cmul_q16(or_, oi, w[2*k], w[2*k+1], &tr, &ti);
+
+		data[2*k+0] = store16((er + tr) >> (shift+1), &peak);
+		data[2*k+1] = store16((ei + ti) >> (shift+1), &peak);
+		if( k != M-k ) {
+			data[2*(M-k)+0] = store16((er - tr) >> (shift+1), &peak);
+			data[2*(M-k)+1] = store16((ti - ei) >> (shift+1), &peak);
+		}
+	}
+
+	*exponent = e;
+
+	return 0;
+}
@@ -0,0 +1,44 @@
+#ifndef FFT_Q15_H
+#define FFT_Q15_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Build the Q15 twiddle table for real transforms of size @p N
+ *
+ * The table is kept in a per-size cache, like the floating point plans.
+ * Not thread safe.
+ *
+ * @param N The number of real samples must be a power of two, at least 4.
+ *
+ * @return Zero for success.
+ */
+int fft_q15_prepare(size_t N);
+
+/**
+ * @brief Release every Q15 twiddle table held in the cache
+ */
+void fft_q15_cleanup(void);
+
+/**
+ * @brief Fixed-point real input FFT algorithm (forward transform), in place
+ *
+ * The @p N real Q15 samples are packed two by two into N/2 complex values,
+ * transformed with an N/2 points radix-2 decimation in time FFT and split
+ * into bins 0 to N/2-1. Data stay in Q15, products are accumulated in Q31
+ * and block floating-point scaling is applied before each stage: the whole
+ * block is shifted right only when its current peak could overflow.
+ *
+ * On return, bin k is (data[2k] + i*data[2k+1]) * 2^(*exponent) in the
+ * units of the input samples.
+ *
+ * @param data An array of @p N samples, overwritten by N/2 interleaved complex bins.
+ * @param N The number of real samples must be a power of two, at least 4.
+ * @param exponent Receives the block exponent of the result.
+ *
+ * @return Zero for success.
+ */
+int fft_q15_real(int16_t *data, size_t N, int *exponent);
+
+#endif
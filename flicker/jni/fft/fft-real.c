@@ -0,0 +1,56 @@
+#include "fft.h"
+
+/*
+ * With Z = FFT(z) of size M = N/2 and z[n] = x[2n] + i*x[2n+1]:
+ *   E[k] = (Z[k] + conj(Z[M-k])) / 2     spectrum of the even samples
+ *   O[k] = (Z[k] - conj(Z[M-k])) / (2i)  spectrum of the odd samples
+ *   X[k] = E[k] + W_N^k * O[k]
+ * Bins k and M-k share E and O (conjugated), so both are computed together
+ * and the post-processing runs in place.
+ */
+static void real_split(float complex *Z, const float complex *w, size_t M)
+{
+	float complex e, o;
+
+	// k = 0 : E and O are the real and imaginary parts of Z[0]
+	Z[0] = crealf(Z[0]) + cimagf(Z[0]);
+
+	for(size_t k = 1; k <= M/2; k++) {
+		float complex a = Z[k];
+		float complex b = conjf(Z[M-k]);
+
+		e = 0.5f * (a + b);
+		o = -0.5f * I * (a - b);
+
+		Z[k] = e + w[k] * o;
+		if( k != M-k )
+			Z[M-k] = conjf(e - w[k] * o);
+	}
+}
+
+int fft_real_execute_pruned(const struct fft_plan *plan, float complex *in, float complex *out, size_t n_valid)
+{
+	if( !plan || plan->N < 2 ) return 1;
+
+	int err = fft_execute_pruned(fft_plan_create(plan->N/2), in, out, (n_valid+1)/2);
+
+	if( err ) return err;
+
+	real_split(out, plan->twiddles, plan->N/2);
+
+	return 0;
+}
+
+int fft_real_execute(const struct fft_plan *plan, float complex *in, float complex *out)
+{
+	return fft_real_execute_pruned(plan, in, out, plan ? plan->N : 0);
+}
+
+int fft_real(float complex *vector, float complex *out, size_t N)
+{
+	if( N < 2 ) return 0;
+
+	if( N & (N-1) ) return 1;
+
+	return fft_real_execute(fft_plan_create(N), vector, out);
+}
@@ -0,0 +1,224 @@
+#include "fft-simd.h"
+
+#if defined(FFT_SIMD) && defined(__x86_64__)
+#include <immintrin.h>
+#define FFT_SIMD_X86 1
+#endif
+
+// the neon kernel is opt-in with FFT_NEON until vd628x_fft_simd_check passes on arm64-v8a
+#if defined(FFT_SIMD) && defined(FFT_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#ifndef HWCAP_ASIMD
+#define HWCAP_ASIMD (1 << 1)
+#endif
+#define FFT_SIMD_NEON 1
+#endif
+
+/*
+ * All kernels compute the radix-2 Stockham stage
+ *   y[q + s*(2p+0)] =  x[q + s*p] + x[q + s*(p+m)]
+ *   y[q + s*(2p+1)] = (x[q + s*p] - x[q + s*(p+m)]) * w[p*s]
+ * with m = N/(2s). When s is at least the vector width, the q loop is
+ * vectorized with a broadcast twiddle. For the first stages (small s), the
+ * p loop is vectorized instead and the two outputs are interleaved on store.
+ */
+
+#ifdef FFT_SIMD_X86
+
+// (a0, a1) * (w0, w1) for two interleaved complex values
+__attribute__((target("sse3")))
+static inline __m128 cmul_sse3(__m128 a, __m128 w)
+{
+	__m128 t = _mm_mul_ps(a, _mm_moveldup_ps(w));
+	__m128 a_swap = _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1));
+
+	return _mm_addsub_ps(t, _mm_mul_ps(a_swap, _mm_movehdup_ps(w)));
+}
+
+__attribute__((target("sse3")))
+static void fft_stage_sse3(const float complex *x, float complex *y, const float complex *w, size_t N, size_t s)
+{
+	size_t m = N/(2*s);
+
+	if( s >= 2 ) {
+		for(size_t p = 0; p < m; p++) {
+			__m128 wp = _mm_castpd_ps(_mm_load1_pd((const double *)&w[p*s]));
+			const float *xa = (const float *)&x[s*(p+0)];
+			const float *xb = (const float *)&x[s*(p+m)];
+			float *y0 = (float *)&y[s*(2*p+0)];
+			float *y1 = (float *)&y[s*(2*p+1)];
+
+			for(size_t q = 0; q < 2*s; q += 4) {
+				__m128 a = _mm_loadu_ps(xa + q);
+				__m128 b = _mm_loadu_ps(xb + q);
+
+				_mm_storeu_ps(y0 + q, _mm_add_ps(a, b));
+				_mm_storeu_ps(y1 + q, cmul_sse3(_mm_sub_ps(a, b), wp));
+			}
+		}
+	}
+	else if( m >= 2 ) {
+		// s = 1 : y[2p] = x[p] + x[p+m], y[2p+1] = (x[p] - x[p+m]) * w[p]
+		for(size_t p = 0; p < m; p += 2) {
+			__m128 a = _mm_loadu_ps((const float *)&x[p]);
+			__m128 b = _mm_loadu_ps((const float *)&x[p+m]);
+			__m128 sum = _mm_add_ps(a, b);
+			__m128 dif = cmul_sse3(_mm_sub_ps(a, b), _mm_loadu_ps((const float *)&w[p]));
+
+			_mm_storeu_ps((float *)&y[2*p+0], _mm_movelh_ps(sum, dif));
+			_mm_storeu_ps((float *)&y[2*p+2], _mm_movehl_ps(dif, sum));
+		}
+	}
+	else {
+		fft_stage_scalar(x, y, w, N, s);
+	}
+}
+
+__attribute__((target("avx2,fma")))
+static void fft_stage_avx2(const float complex *x, float complex *y, const float complex *w, size_t N, size_t s)
+{
+	size_t m = N/(2*s);
+
+	if( s < 4 ) {
+		fft_stage_sse3(x, y, w, N, s);
+		return;
+	}
+
+	for(size_t p = 0; p < m; p++) {
+		__m256 wp = _mm256_castpd_ps(_mm256_broadcast_sd((const double *)&w[p*s]));
+		__m256 wr = _mm256_moveldup_ps(wp);
+		__m256 wi = _mm256_movehdup_ps(wp);
+		const float *xa = (const float *)&x[s*(p+0)];
+		const float *xb = (const float *)&x[s*(p+m)];
+		float *y0 = (float *)&y[s*(2*p+0)];
+		float *y1 = (float *)&y[s*(2*p+1)];
+
+		for(size_t q = 0; q < 2*s; q += 8) {
+			__m256 a = _mm256_loadu_ps(xa + q);
+			__m256 b = _mm256_loadu_ps(xb + q);
+			__m256 d = _mm256_sub_ps(a, b);
+			__m256 d_swap = _mm256_permute_ps(d, _MM_SHUFFLE(2, 3, 0, 1));
+
+			_mm256_storeu_ps(y0 + q, _mm256_add_ps(a, b));
+			_mm256_storeu_ps(y1 + q, _mm256_fmaddsub_ps(d, wr, _mm256_mul_ps(d_swap, wi)));
+		}
+	}
+}
+
+#endif
+
+#ifdef FFT_SIMD_NEON
+
+static void fft_stage_neon(const float complex *x, float complex *y, const float complex *w, size_t N, size_t s)
+{
+	size_t m = N/(2*s);
+
+	if( s >= 4 ) {
+		// 4 complex values per iteration, deinterleaved into real and imaginary planes
+		for(size_t p = 0; p < m; p++) {
+			float32x4_t wr = vdupq_n_f32(crealf(w[p*s]));
+			float32x4_t wi = vdupq_n_f32(cimagf(w[p*s]));
+			const float *xa = (const float *)&x[s*(p+0)];
+			const float *xb = (const float *)&x[s*(p+m)];
+			float *y0 = (float *)&y[s*(2*p+0)];
+			float *y1 = (float *)&y[s*(2*p+1)];
+
+			for(size_t q = 0; q < 2*s; q += 8) {
+				float32x4x2_t a = vld2q_f32(xa + q);
+				float32x4x2_t b = vld2q_f32(xb + q);
+				float32x4x2_t sum, dif;
+				float32x4_t dr = vsubq_f32(a.val[0], b.val[0]);
+				float32x4_t di = vsubq_f32(a.val[1], b.val[1]);
+
+				sum.val[0] = vaddq_f32(a.val[0], b.val[0]);
+				sum.val[1] = vaddq_f32(a.val[1], b.val[1]);
+				dif.val[0] = vfmsq_f32(vmulq_f32(dr, wr), di, wi);
+				dif.val[1] = vfmaq_f32(vmulq_f32(dr, wi), di, wr);
+
+				vst2q_f32(y0 + q, sum);
+				vst2q_f32(y1 + q, dif);
+			}
+		}
+	}
+	else if( s == 1 && m >= 4 ) {
+		// y[2p], y[2p+1] for 4 consecutive p : one 4-way interleaved store
+		for(size_t p = 0; p < m; p += 4) {
+			float32x4x2_t a = vld2q_f32((const float *)&x[p]);
+			float32x4x2_t b = vld2q_f32((const float *)&x[p+m]);
+			float32x4x2_t wp = vld2q_f32((const float *)&w[p]);
+			float32x4x4_t out;
+			float32x4_t dr = vsubq_f32(a.val[0], b.val[0]);
+			float32x4_t di = vsubq_f32(a.val[1], b.val[1]);
+
+			out.val[0] = vaddq_f32(a.val[0], b.val[0]);
+			out.val[1] = vaddq_f32(a.val[1], b.val[1]);
+			out.val[2] = vfmsq_f32(vmulq_f32(dr, wp.val[0]), di, wp.val[1]);
+			out.val[3] = vfmaq_f32(vmulq_f32(dr, wp.val[1]), di, wp.val[0]);
+
+			vst4q_f32((float *)&y[2*p], out);
+		}
+	}
+	else {
+		fft_stage_scalar(x, y, w, N, s);
+	}
+}
+
+#endif
+
+int fft_simd_kernels(fft_stage_kernel *kernels, const char **names, int nb)
+{
+	int n = 0;
+
+#define FFT_SIMD_ADD(kernel, name) \
+	do { \
+		if( n < nb ) { \
+			kernels[n] = kernel; \
+			if( names ) \
+				names[n] = name; \
+		} \
+		n++; \
+	} while(0)
+
+	FFT_SIMD_ADD(fft_stage_scalar, "scalar");
+
+#ifdef FFT_SIMD_X86
+	__builtin_cpu_init();
+	if( __builtin_cpu_supports("sse3") )
+		FFT_SIMD_ADD(fft_stage_sse3, "sse3");
+	if( __builtin_cpu_supports("sse3") && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") )
+		FFT_SIMD_ADD(fft_stage_avx2, "avx2");
+#endif
+
+#ifdef FFT_SIMD_NEON
+	if( getauxval(AT_HWCAP) & HWCAP_ASIMD )
+		FFT_SIMD_ADD(fft_stage_neon, "neon");
+#endif
+
+#undef FFT_SIMD_ADD
+
+	return n;
+}
+
+fft_stage_kernel fft_simd_select(const char **name)
+{
+	static fft_stage_kernel kernel = NULL;
+	static const char *kernel_name = NULL;
+
+	if( !kernel ) {
+		fft_stage_kernel kernels[FFT_SIMD_KERNELS_MAX];
+		const char *names[FFT_SIMD_KERNELS_MAX];
+		int n = fft_simd_kernels(kernels, names, FFT_SIMD_KERNELS_MAX);
+
+		// the kernels are listed from the slowest to the fastest
+		if( n > FFT_SIMD_KERNELS_MAX )
+			n = FFT_SIMD_KERNELS_MAX;
+		kernel_name = names[n-1];
+		kernel = kernels[n-1];
+	}
+
+	if( name )
+		*name = kernel_name;
+
+	return kernel;
+}
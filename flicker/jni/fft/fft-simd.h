@@ -0,0 +1,55 @@
+#ifndef FFT_SIMD_H
+#define FFT_SIMD_H
+
+#include <complex.h>
+#include <stddef.h>
+
+/**
+ * @brief Radix-2 Stockham stage kernel
+ *
+ * Runs the stage of stride @p s of an @p N points transform from @p x to @p y,
+ * using the natural order twiddles @p w of the plan. Every butterfly loads its
+ * inputs before storing its outputs, so the last stage (s = N/2) can run with
+ * @p x equal to @p y.
+ */
+typedef void (*fft_stage_kernel)(const float complex *x, float complex *y, const float complex *w, size_t N, size_t s);
+
+/**
+ * @brief Portable C99 stage kernel, used when no vector unit is detected
+ */
+void fft_stage_scalar(const float complex *x, float complex *y, const float complex *w, size_t N, size_t s);
+
+/**
+ * @brief Max number of kernels listed by fft_simd_kernels
+ */
+#define FFT_SIMD_KERNELS_MAX 4
+
+/**
+ * @brief List the stage kernels the running CPU can execute
+ *
+ * The scalar kernel comes first, then the vector ones from the slowest to the
+ * fastest. Meant to check the vector kernels against the scalar one.
+ *
+ * @param kernels Receives up to @p nb kernels.
+ * @param names If not NULL, receives the names of the kernels.
+ * @param nb Size of @p kernels and @p names.
+ *
+ * @return The number of kernels the CPU can execute, which may exceed @p nb.
+ */
+int fft_simd_kernels(fft_stage_kernel *kernels, const char **names, int nb);
+
+/**
+ * @brief Select the best stage kernel for the running CPU
+ *
+ * CPU features are probed on the first call only (AVX2+FMA or SSE3 on x86-64,
+ * Advanced SIMD on aarch64 if the build also defines FFT_NEON). The scalar
+ * kernel is returned when the build does not define FFT_SIMD or when the CPU
+ * has none of these units.
+ *
+ * @param name If not NULL, receives the name of the selected kernel.
+ *
+ * @return The stage kernel.
+ */
+fft_stage_kernel fft_simd_select(const char **name);
+
+#endif
@@ -0,0 +1,123 @@
+#include "fft.h"
+#include "fft-simd.h"
+#include <string.h>
+
+/*
+ * Radix-2 Stockham autosort FFT (decimation in frequency).
+ *
+ * With n the current sub-transform size, m = n/2 and s = N/n the stride, a
+ * stage reads every element once and writes every element once:
+ *   y[q + s*(2p+0)] =  x[q + s*p] + x[q + s*(p+m)]
+ *   y[q + s*(2p+1)] = (x[q + s*p] - x[q + s*(p+m)]) * W_N^(p*s)
+ * for 0 <= p < m and 0 <= q < s. The output of the last stage is in natural
+ * order, so no bit reversal pass is needed.
+ *
+ * This is the scalar kernel; vectorized ones are selected at run time by
+ * fft_simd_select().
+ */
+void fft_stage_scalar(const float complex *x, float complex *y, const float complex *w, size_t N, size_t s)
+{
+	size_t m = N/(2*s);
+
+	for(size_t p = 0; p < m; p++) {
+		float complex wp = w[p*s];
+
+		for(size_t q = 0; q < s; q++) {
+			float complex a = x[q + s*(p+0)];
+			float complex b = x[q + s*(p+m)];
+
+			y[q + s*(2*p+0)] = a + b;
+			y[q + s*(2*p+1)] = (a - b) * wp;
+		}
+	}
+}
+
+/*
+ * First stages when only x[0..L-1] can be non zero, with L <= N/2 and L a
+ * multiple of s : every x[q + s*(p+m)] is zero, and so is every x[q + s*p]
+ * with p >= L/s. The butterflies reduce to a copy and a twiddle product,
+ * only for p < L/s. They write y[0..2L-1], which is the non zero prefix
+ * read by the next stage.
+ */
+static void stockham_stage_pruned(const float complex *x, float complex *y, const float complex *w, size_t s, size_t L)
+{
+	const float *xf = (const float *)x;
+	float *yf = (float *)y;
+
+	// plain real arithmetic (no C99 complex product special cases) so that
+	// the compiler can vectorize the q loop
+	for(size_t p = 0; p < L/s; p++) {
+		float wr = crealf(w[p*s]);
+		float wi = cimagf(w[p*s]);
+		const float *a = xf + 2*s*p;
+		float *y0 = yf + 2*s*(2*p+0);
+		float *y1 = yf + 2*s*(2*p+1);
+
+		for(size_t q = 0; q < 2*s; q += 2) {
+			float ar = a[q], ai = a[q+1];
+
+			y0[q] = ar;
+			y0[q+1] = ai;
+			y1[q] = ar*wr - ai*wi;
+			y1[q+1] = ar*wi + ai*wr;
+		}
+	}
+}
+
+int fft_stockham_execute_pruned(const struct fft_plan *plan, float complex *in, float complex *out, size_t n_valid)
+{
+	if( !plan ) return 1;
+
+	if( !out ) return -1;
+
+	size_t N = plan->N;
+	int J = plan->log2N;
+
+	if( J == 0 ) {
+		out[0] = in[0];
+		return 0;
+	}
+
+	// non zero prefix, rounded up to a power of two so that it stays a
+	// multiple of the stride of every pruned stage
+	size_t L = 1;
+
+	while( L < n_valid && L < N )
+		L <<= 1;
+
+	// the pruned stages read the whole prefix
+	if( n_valid < L )
+		memset(in + n_valid, 0, (L - n_valid)*sizeof(float complex));
+
+	fft_stage_kernel stage = fft_simd_select(NULL);
+	float complex *buffers[2] = { in, out };
+	int b = 0;
+	int j = 0;
+
+	// the non zero prefix doubles at each stage
+	for(; j < J-1 && L <= N/2; j++, b++, L <<= 1) {
+		stockham_stage_pruned(buffers[b&1], buffers[~b&1], plan->twiddles, (size_t)1 << j, L);
+	}
+
+	// remaining stages but the last one ping-pong between the two buffers
+	for(; j < J-1; j++, b++) {
+		stage(buffers[b&1], buffers[~b&1], plan->twiddles, N, (size_t)1 << j);
+	}
+
+	// the last stage (s = N/2, unit twiddle) writes its outputs at the
+	// positions of its inputs : it either moves the data to out or runs
+	// in place in out, so that the result is always in out whatever the
+	// parity of log2(N). If the data are still pruned (L = N/2), x[N/2..N-1]
+	// has never been written and the stage is a copy of x[0..N/2-1] to both halves
+	if( L <= N/2 )
+		stockham_stage_pruned(buffers[b&1], out, plan->twiddles, N/2, L);
+	else
+		stage(buffers[b&1], out, plan->twiddles, N, N/2);
+
+	return 0;
+}
+
+int fft_stockham_execute(const struct fft_plan *plan, float complex *in, float complex *out)
+{
+	return fft_stockham_execute_pruned(plan, in, out, plan ? plan->N : 0);
+}
@@ -3,18 +3,195 @@
 
 #include <complex.h>
 #include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Largest transform handled by a plan, as a power of two.
+ */
+#define FFT_PLAN_MAX_LOG2 16
+
+/**
+ * @brief Precomputed FFT plan
+ *
+ * Holds everything that only depends on the transform size: the twiddle
+ * factors W_N^k = exp(-2*pi*i*k/N) in natural order for k < N/2, and the
+ * (log2(N)-1)-bit reversal of every butterfly block index.
+ */
+struct fft_plan {
+	size_t N;
+	int log2N;
+	float complex *twiddles;
+	uint16_t *rev;
+};
+
+/**
+ * @brief Get the plan for a transform of size @p N
+ *
+ * Tables are built on the first request for a given size and then kept in a
+ * per-size cache, so that later calls (new windows, sampling frequency
+ * changes) are a simple lookup. Not thread safe: plans must be created from
+ * one thread at a time.
+ *
+ * @param N The size of the transform must be a power of two.
+ *
+ * @return The plan, or NULL if @p N is not supported or allocation failed.
+ */
+const struct fft_plan *fft_plan_create(size_t N);
+
+/**
+ * @brief Release every plan held in the cache
+ *
+ * Plans previously returned by fft_plan_create() must not be used afterwards.
+ */
+void fft_plan_cleanup(void);
+
+/**
+ * @brief FFT algorithm (forward transform) using a precomputed plan
+ *
+ * @param plan Plan returned by fft_plan_create().
+ * @param in An array of @p plan->N complex values, used as work buffer (overwritten).
+ * @param out An array of @p plan->N complex values receiving the spectrum in natural order.
+ *
+ * @return Zero for success.
+ */
+int fft_execute(const struct fft_plan *plan, float complex *in, float complex *out);
+
+/**
+ * @brief Decimation in time FFT algorithm (forward transform) using a precomputed plan
+ *
+ * uFFT engine : the data are bit reversed before and after the butterfly
+ * passes, one copy pass per bit. fft_execute() runs this engine by default.
+ *
+ * @param plan Plan returned by fft_plan_create().
+ * @param in An array of @p plan->N complex values, used as work buffer (overwritten).
+ * @param out An array of @p plan->N complex values receiving the spectrum in natural order.
+ *
+ * @return Zero for success.
+ */
+int fft_dit_execute(const struct fft_plan *plan, float complex *in, float complex *out);
+
+/**
+ * @brief Stockham autosort FFT algorithm (forward transform) using a precomputed plan
+ *
+ * Every stage makes exactly one read and one write sweep over the data and
+ * the spectrum comes out in natural order, without bit reversal passes.
+ * fft_execute() runs this engine when built with FFT_STOCKHAM.
+ *
+ * @param plan Plan returned by fft_plan_create().
+ * @param in An array of @p plan->N complex values, used as work buffer (overwritten).
+ * @param out An array of @p plan->N complex values receiving the spectrum in natural order.
+ *
+ * @return Zero for success.
+ */
+int fft_stockham_execute(const struct fft_plan *plan, float complex *in, float complex *out);
+
+/**
+ * @brief Input-pruned Stockham FFT algorithm (forward transform) using a precomputed plan
+ *
+ * Same as fft_stockham_execute() for an input whose values from @p n_valid
+ * to N-1 are zero. Those values do not need to be written by the caller :
+ * the non zero part is rounded up to L, the next power of two, and the
+ * values from @p n_valid to L-1 are cleared here. The values from L to N-1
+ * are never read. The first log2(N/L) stages only compute the butterflies
+ * of the non zero part and skip the zero operands.
+ *
+ * @param plan Plan returned by fft_plan_create().
+ * @param in An array of @p plan->N complex values, of which the first @p n_valid are used (overwritten).
+ * @param out An array of @p plan->N complex values receiving the spectrum in natural order.
+ * @param n_valid Number of leading input values that can be non zero.
+ *
+ * @return Zero for success.
+ */
+int fft_stockham_execute_pruned(const struct fft_plan *plan, float complex *in, float complex *out, size_t n_valid);
+
+/**
+ * @brief Input-pruned FFT algorithm (forward transform)
+ *
+ * Runs fft_stockham_execute_pruned() when built with FFT_STOCKHAM. The uFFT
+ * engine does not prune : the values from @p n_valid to N-1 are cleared in
+ * @p in and the full transform is run.
+ */
+int fft_execute_pruned(const struct fft_plan *plan, float complex *in, float complex *out, size_t n_valid);
 
 /**
  * @brief FFT algorithm (forward transform)
  *
  * This function computes forward radix-2 fast Fourier transform (FFT).
- * The output is written in-place over the input.
+ * It is a wrapper over fft_execute() using the cached plan for @p N.
  *
- * @param vector An array of @p N complex values in single-precision floating-point format.
+ * @param vector An array of @p N complex values in single-precision floating-point format (overwritten).
+ * @param out An array of @p N complex values receiving the result.
  * @param N The size of the transform must be a power of two.
  *
  * @return Zero for success.
  */
 int fft(float complex *vector, float complex *out, size_t N);
 
+/**
+ * @brief Real input FFT algorithm (forward transform) using a precomputed plan
+ *
+ * The @p plan->N real samples are packed two by two as z[n] = x[2n] + i*x[2n+1].
+ * An N/2 points complex FFT is run on them and the result is post-processed
+ * into the first half of the N points spectrum.
+ *
+ * @param plan Plan of size N returned by fft_plan_create(). The plan of size N/2 is fetched from the cache.
+ * @param in An array of @p plan->N/2 packed complex values, used as work buffer (overwritten).
+ * @param out An array of @p plan->N/2 complex values receiving bins 0 to N/2-1.
+ *
+ * @return Zero for success.
+ */
+int fft_real_execute(const struct fft_plan *plan, float complex *in, float complex *out);
+
+/**
+ * @brief Input-pruned real input FFT algorithm (forward transform)
+ *
+ * Same as fft_real_execute() when only the first @p n_valid real samples can
+ * be non zero : only the first (n_valid+1)/2 packed values of @p in are read
+ * (see fft_execute_pruned()). For an odd @p n_valid, the imaginary part of
+ * the last one, sample n_valid, must be zero.
+ */
+int fft_real_execute_pruned(const struct fft_plan *plan, float complex *in, float complex *out, size_t n_valid);
+
+/**
+ * @brief Real input FFT algorithm (forward transform)
+ *
+ * Wrapper over fft_real_execute() using the cached plan for @p N.
+ *
+ * @param vector An array of @p N/2 packed complex values (overwritten).
+ * @param out An array of @p N/2 complex values receiving bins 0 to N/2-1.
+ * @param N The number of real samples must be a power of two, at least 2.
+ *
+ * @return Zero for success.
+ */
+int fft_real(float complex *vector, float complex *out, size_t N);
+
+/**
+ * @brief Partial DFT of a real signal
+ *
+ * Computes bins @p k_first to @p k_last (included) of the N points DFT of
+ * @p x by direct evaluation, N being @p plan->N. Only the bins of the range
+ * are written, at their index in @p out.
+ *
+ * @param plan Plan of size N returned by fft_plan_create(), providing the twiddles.
+ * @param x An array of real samples, of which the first @p n_valid are used (the other ones are zero).
+ * @param n_valid Number of leading samples that can be non zero.
+ * @param out An array of at least @p k_last + 1 complex values.
+ * @param k_first First bin of the range.
+ * @param k_last Last bin of the range, lower than N.
+ *
+ * @return Zero for success.
+ */
+int fft_dft_real_bins(const struct fft_plan *plan, const float *x, size_t n_valid, float complex *out, size_t k_first, size_t k_last);
+
+/**
+ * @brief Tell whether fft_dft_real_bins() is cheaper than the real input FFT
+ *
+ * @param N The size of the transform.
+ * @param n_valid Number of leading samples that can be non zero.
+ * @param bins Number of bins needed.
+ *
+ * @return Non zero when the direct evaluation of @p bins bins costs less than the full transform.
+ */
+int fft_dft_is_cheaper(size_t N, size_t n_valid, size_t bins);
+
 #endif
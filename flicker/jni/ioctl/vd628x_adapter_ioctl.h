@@ -11,6 +11,8 @@ This file is licensed under open source license ST SLA0103
 #define VD628x_IOCTL_GET_SPI_INFO	_IOWR('r', 0x01, struct vd628x_spi_info)
 #define VD628x_IOCTL_SET_SPI_PARAMS	_IOW('r', 0x02, struct vd628x_spi_params)
 #define VD628x_IOCTL_GET_CHUNK_SAMPLES	_IOWR('r', 0x03, __u16)
+#define VD628x_IOCTL_GET_CHUNKS_SAMPLES	_IOWR('r', 0x04, struct vd628x_chunks_samples)
+#define VD628x_IOCTL_SET_RING		_IOWR('r', 0x05, struct vd628x_ring_info)
 
 struct vd628x_reg {
 	__u8 index;
@@ -28,5 +30,41 @@ struct vd628x_spi_params {
 	__u16 pdm_data_sample_width_in_bytes;
 };
 
+// chunks_nb consecutive chunks, i.e. chunks_nb * samples_nb_per_chunk samples
+// samples is the user space address of the samples. chunks_nb = 0 transfers nothing
+// on a device opened with O_NONBLOCK, the chunks already captured are transferred, up to
+// chunks_nb, and chunks_nb returns their number. -1 with errno EAGAIN if there is none yet :
+// poll on the device reports POLLIN once a chunk is ready
+struct vd628x_chunks_samples {
+	__u64 samples;
+	__u32 chunks_nb;
+	__u32 reserved;
+};
+
+// VD628x_IOCTL_SET_RING : the driver captures chunks continuously in a ring of
+// chunks_nb chunks, mapped by mmap on the device. map_size is returned : the
+// size to map, header included. chunks_nb = 0 stops the ring
+struct vd628x_ring_info {
+	__u32 chunks_nb;
+	__u32 map_size;
+};
+
+// header at the start of the ring mapping. the chunks start at data_offset
+// producer and consumer are free running chunk counters, chunk n is at n % chunks_nb
+// the driver writes chunks and moves producer, user space reads them in place and moves consumer
+// the driver drops the chunks it has no room for and counts them in overruns
+#define VD628x_RING_MAGIC 0x52383236
+
+struct vd628x_ring_header {
+	__u32 magic;
+	__u32 chunks_nb;
+	__u32 chunk_samples;
+	__u32 data_offset;
+	__u32 producer;
+	__u32 consumer;
+	__u32 overruns;
+	__u32 reserved;
+};
+
 
 #endif
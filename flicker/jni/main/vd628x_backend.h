@@ -0,0 +1,63 @@
+/********************************************************************************
+Copyright (c) 2025, STMicroelectronics - All Rights Reserved
+This file is licensed under open source license ST SLA0103
+********************************************************************************/
+#ifndef __VD628X_BACKEND__
+#define __VD628X_BACKEND__ 1
+
+#include <stdint.h>
+#include <linux/types.h>
+#include "vd628x_adapter_ioctl.h"
+#include "vd628x_ring.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct vd628x_backend_info {
+	uint32_t chunk_size;         // bytes of pdm data per chunk
+	uint32_t spi_max_frequency;  // in Hz
+	uint16_t batch_chunks;       // max chunks per read_chunks
+};
+
+//
+// vd628x_backend
+// source of the flicker channel chunks behind the platform_* functions
+// the device name selects the backend : see platform_spi_start
+//
+struct vd628x_backend {
+	// device names of the backend start with prefix. NULL for the kernel device
+	const char * prefix;
+	// opens the device and fills info. returns the context of the device or NULL
+	void * (*open)(const char * device, struct vd628x_backend_info * info);
+	// applies the capture parameters. the chunks read from now on follow them
+	int (*configure)(void * context, const struct vd628x_spi_params * params);
+	// reads up to chunks_nb chunks without blocking. returns the number of chunks
+	// read, 0 if none is ready, -1 on error
+	int (*read_chunks)(void * context, int16_t * samples, uint16_t chunks_nb);
+	// descriptor polled for POLLIN until chunks are ready
+	int (*poll_fd)(void * context);
+	// optional : called once poll_fd reported POLLIN, for a descriptor that stays
+	// readable until it is read
+	void (*poll_ack)(void * context);
+	// optional : maps a ring of chunks_nb chunks written by the device, read in
+	// place instead of read_chunks. returns -1 if the device has no ring
+	int (*map_ring)(void * context, uint32_t chunks_nb, struct vd628x_ring * ring);
+	void (*unmap_ring)(void * context, struct vd628x_ring * ring);
+	void (*close)(void * context);
+};
+
+// /dev/vd628x_spi driver
+extern const struct vd628x_backend vd628x_backend_kernel;
+// "file:<path>" : int16 samples of a file, looped, at the pace of the sampling frequency
+extern const struct vd628x_backend vd628x_backend_file;
+// "synthetic:<Hz>" : flicker of the given frequency, 100 Hz by default
+extern const struct vd628x_backend vd628x_backend_synthetic;
+// "ring:<path>" : sample ring of a shared memory file, see test/vd628x_ring_producer.c
+extern const struct vd628x_backend vd628x_backend_ring;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,384 @@
+/********************************************************************************
+Copyright (c) 2025, STMicroelectronics - All Rights Reserved
+This file is licensed under open source license ST SLA0103
+********************************************************************************/
+//
+// backends running without the sensor, on any linux host : chunks are made
+// available at the pace of the sampling frequency by a timerfd
+// file : int16 samples read from a file, looped at its end
+// synthetic : flicker of a given frequency
+// ring : sample ring of a shared memory file written by a stand-in producer. a file
+// has no poll support : the ring is checked every chunk period
+//
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sys/timerfd.h>
+
+#include "vd628x_backend.h"
+
+#define LOG printf
+
+#define MIN(a,b) ((a)<(b)?(a):(b))
+
+// same chunks and bus as the vd628x_spi driver
+#define HOST_CHUNK_SIZE 4096
+#define HOST_SPI_MAX_FREQUENCY (4*1024*1024)
+#define HOST_BATCH_CHUNKS 16
+// chunks not read after this time are dropped, like the driver does
+#define HOST_BACKLOG_SECONDS 2
+
+#define SYNTHETIC_DEFAULT_FREQUENCY 100
+
+//
+// host_device
+//
+struct host_device {
+	int timer_fd;
+	uint64_t pending;           // chunks due and not read yet
+	uint64_t backlog_max;
+	uint32_t sampling_frequency;
+	uint16_t chunk_samples;
+	// file backend
+	int fd;
+	// synthetic backend
+	float flicker_frequency;
+	uint64_t sample;
+	// ring backend : ring of the file fd, and next chunk read by read_chunks
+	struct vd628x_ring ring;
+	size_t map_size;
+	uint32_t position;
+};
+
+
+//
+// host_open
+// part of the opening common to the file and synthetic backends
+//
+static struct host_device * host_open(struct vd628x_backend_info * info)
+{
+	struct host_device *dev;
+
+	dev = (struct host_device *)calloc(1, sizeof(struct host_device));
+	if (dev == NULL)
+		return NULL;
+
+	dev->fd = -1;
+	dev->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+	if (dev->timer_fd < 0) {
+		LOG("FATAL error : Could not create the host backend timer\n");
+		free(dev);
+		return NULL;
+	}
+
+	info->chunk_size = HOST_CHUNK_SIZE;
+	info->spi_max_frequency = HOST_SPI_MAX_FREQUENCY;
+	info->batch_chunks = HOST_BATCH_CHUNKS;
+
+	return dev;
+}
+
+//
+// host_configure
+// one chunk is due every samples_nb_per_chunk samples from now on
+//
+static int host_configure(void * context, const struct vd628x_spi_params * params)
+{
+	struct host_device *dev = context;
+	struct itimerspec period;
+	uint64_t period_ns;
+
+	if ((params->pdm_data_sample_width_in_bytes == 0) || (params->samples_nb_per_chunk == 0))
+		return -1;
+
+	dev->sampling_frequency = params->speed_hz / 8 / params->pdm_data_sample_width_in_bytes;
+	dev->chunk_samples = params->samples_nb_per_chunk;
+	dev->pending = 0;
+	dev->backlog_max = (uint64_t)HOST_BACKLOG_SECONDS * dev->sampling_frequency / dev->chunk_samples;
+
+	period_ns = (uint64_t)dev->chunk_samples * 1000000000 / dev->sampling_frequency;
+	period.it_interval.tv_sec = period_ns / 1000000000;
+	period.it_interval.tv_nsec = period_ns % 1000000000;
+	period.it_value = period.it_interval;
+	if (timerfd_settime(dev->timer_fd, 0, &period, NULL)) {
+		LOG("FATAL error : Could not start the host backend timer\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+//
+// host_due_chunks
+// number of chunks that can be read now, up to chunks_nb
+//
+static uint16_t host_due_chunks(struct host_device *dev, uint16_t chunks_nb)
+{
+	uint64_t expirations;
+
+	if (read(dev->timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations))
+		dev->pending = MIN(dev->pending + expirations, dev->backlog_max);
+
+	return (uint16_t)MIN(dev->pending, (uint64_t)chunks_nb);
+}
+
+//
+// host_poll_fd
+//
+static int host_poll_fd(void * context)
+{
+	struct host_device *dev = context;
+
+	return dev->timer_fd;
+}
+
+//
+// host_close
+//
+static void host_close(void * context)
+{
+	struct host_device *dev = context;
+
+	vd628x_ring_unmap(&dev->ring);
+	if (dev->fd >= 0)
+		close(dev->fd);
+	close(dev->timer_fd);
+	free(dev);
+}
+
+//
+// file_open
+// "file:<path>"
+//
+static void * file_open(const char * device, struct vd628x_backend_info * info)
+{
+	const char * path = device + strlen("file:");
+	struct host_device *dev;
+
+	dev = host_open(info);
+	if (dev == NULL)
+		return NULL;
+
+	dev->fd = open(path, O_RDONLY);
+	if (dev->fd < 0) {
+		LOG("FATAL error : Could not open %s\n", path);
+		host_close(dev);
+		return NULL;
+	}
+
+	return dev;
+}
+
+//
+// file_read_chunks
+// the file is read again from its start once its end is reached
+//
+static int file_read_chunks(void * context, int16_t * samples, uint16_t chunks_nb)
+{
+	struct host_device *dev = context;
+	size_t size, done = 0;
+	ssize_t ret;
+	int rewound = 0;
+
+	chunks_nb = host_due_chunks(dev, chunks_nb);
+	size = (size_t)chunks_nb * dev->chunk_samples * sizeof(int16_t);
+
+	while (done < size) {
+		ret = read(dev->fd, (char *)samples + done, size - done);
+		if (ret < 0)
+			return -1;
+		if (ret == 0) {
+			// an empty file can't provide any sample
+			if (rewound || (lseek(dev->fd, 0, SEEK_SET) < 0))
+				return -1;
+			rewound = 1;
+			continue;
+		}
+		rewound = 0;
+		done += ret;
+	}
+
+	dev->pending -= chunks_nb;
+
+	return chunks_nb;
+}
+
+//
+// synthetic_open
+// "synthetic:<Hz>"
+//
+static void * synthetic_open(const char * device, struct vd628x_backend_info * info)
+{
+	const char * frequency = device + strlen("synthetic:");
+	struct host_device *dev;
+
+	dev = host_open(info);
+	if (dev == NULL)
+		return NULL;
+
+	dev->flicker_frequency = (*frequency != 0) ? strtof(frequency, NULL) : SYNTHETIC_DEFAULT_FREQUENCY;
+	LOG("synthetic flicker of %f Hz\n", dev->flicker_frequency);
+
+	return dev;
+}
+
+//
+// synthetic_read_chunks
+// same flicker as the stand-in producer of the sample ring
+//
+static int synthetic_read_chunks(void * context, int16_t * samples, uint16_t chunks_nb)
+{
+	struct host_device *dev = context;
+	uint32_t s, samples_nb;
+
+	chunks_nb = host_due_chunks(dev, chunks_nb);
+	samples_nb = (uint32_t)chunks_nb * dev->chunk_samples;
+
+	for (s = 0; s < samples_nb; s++, dev->sample++)
+		samples[s] = (int16_t)(8192 + 2048 * sin(2 * M_PI * dev->flicker_frequency * dev->sample / dev->sampling_frequency));
+
+	dev->pending -= chunks_nb;
+
+	return chunks_nb;
+}
+
+//
+// ring_open
+// "ring:<path>"
+//
+static void * ring_open(const char * device, struct vd628x_backend_info * info)
+{
+	const char * path = device + strlen("ring:");
+	struct vd628x_ring_header header;
+	struct host_device *dev;
+
+	dev = host_open(info);
+	if (dev == NULL)
+		return NULL;
+
+	dev->fd = open(path, O_RDWR);
+	if ((dev->fd < 0) || (pread(dev->fd, &header, sizeof(header), 0) != sizeof(header))) {
+		LOG("FATAL error : Could not read the sample ring of %s\n", path);
+		host_close(dev);
+		return NULL;
+	}
+
+	dev->map_size = header.data_offset + (size_t)header.chunks_nb * header.chunk_samples * sizeof(int16_t);
+	if (vd628x_ring_map(&dev->ring, dev->fd, dev->map_size)) {
+		host_close(dev);
+		return NULL;
+	}
+	dev->position = vd628x_ring_consumer(&dev->ring);
+
+	return dev;
+}
+
+//
+// ring_configure
+// the chunks of the ring are written by the producer : they must match the parameters
+//
+static int ring_configure(void * context, const struct vd628x_spi_params * params)
+{
+	struct host_device *dev = context;
+
+	if (params->samples_nb_per_chunk != dev->ring.header->chunk_samples) {
+		LOG("FATAL error : %d samples per chunk expected, %d in the sample ring\n",
+			params->samples_nb_per_chunk, dev->ring.header->chunk_samples);
+		return -1;
+	}
+
+	return host_configure(context, params);
+}
+
+//
+// ring_read_chunks
+// copies the chunks of the ring when the platform does not map it
+//
+static int ring_read_chunks(void * context, int16_t * samples, uint16_t chunks_nb)
+{
+	struct host_device *dev = context;
+	uint32_t n;
+
+	n = MIN(vd628x_ring_available(&dev->ring, dev->position), (uint32_t)chunks_nb);
+	vd628x_ring_copy(&dev->ring, samples, dev->position, n);
+	dev->position += n;
+	vd628x_ring_release(&dev->ring, dev->position);
+
+	return n;
+}
+
+//
+// ring_poll_ack
+// the timer stays readable until its expirations are read
+//
+static void ring_poll_ack(void * context)
+{
+	struct host_device *dev = context;
+	uint64_t expirations;
+
+	if (read(dev->timer_fd, &expirations, sizeof(expirations)) < 0)
+		return;
+}
+
+//
+// ring_map_ring
+// maps the ring of the file as the platform maps the ring of the driver. the ring
+// size is set by the producer
+//
+static int ring_map_ring(void * context, uint32_t chunks_nb, struct vd628x_ring * ring)
+{
+	struct host_device *dev = context;
+
+	(void)chunks_nb;
+	return vd628x_ring_map(ring, dev->fd, dev->map_size);
+}
+
+//
+// ring_unmap_ring
+//
+static void ring_unmap_ring(void * context, struct vd628x_ring * ring)
+{
+	(void)context;
+	vd628x_ring_unmap(ring);
+}
+
+const struct vd628x_backend vd628x_backend_file = {
+	"file:",
+	file_open,
+	host_configure,
+	file_read_chunks,
+	host_poll_fd,
+	NULL,
+	NULL,
+	NULL,
+	host_close
+};
+
+const struct vd628x_backend vd628x_backend_synthetic = {
+	"synthetic:",
+	synthetic_open,
+	host_configure,
+	synthetic_read_chunks,
+	host_poll_fd,
+	NULL,
+	NULL,
+	NULL,
+	host_close
+};
+
+const struct vd628x_backend vd628x_backend_ring = {
+	"ring:",
+	ring_open,
+	ring_configure,
+	ring_read_chunks,
+	host_poll_fd,
+	ring_poll_ack,
+	ring_map_ring,
+	ring_unmap_ring,
+	host_close
+};
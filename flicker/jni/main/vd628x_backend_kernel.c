@@ -0,0 +1,231 @@
+/********************************************************************************
+Copyright (c) 2025, STMicroelectronics - All Rights Reserved
+This file is licensed under open source license ST SLA0103
+********************************************************************************/
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+
+#include "vd628x_backend.h"
+
+#define LOG printf
+
+// max chunks per transfer when the driver supports batched transfers
+#ifndef PLATFORM_BATCH_CHUNKS
+#define PLATFORM_BATCH_CHUNKS 16
+#endif
+
+//
+// kernel_device
+// vd628x_spi driver. batch_transfers is 1 if the driver has no batched transfers
+// read_only if the device could not be opened for writing : no mapped ring
+//
+struct kernel_device {
+	int fd;
+	uint16_t batch_transfers;
+	uint8_t read_only;
+};
+
+
+//
+// probe_batch_transfers
+// a driver without VD628x_IOCTL_GET_CHUNKS_SAMPLES rejects the request : the
+// chunks are then transferred one per ioctl
+//
+static void probe_batch_transfers(struct kernel_device *dev)
+{
+	struct vd628x_chunks_samples chunks;
+
+	// no chunk is transferred
+	chunks.samples = 0;
+	chunks.chunks_nb = 0;
+	if (ioctl(dev->fd, VD628x_IOCTL_GET_CHUNKS_SAMPLES, &chunks)) {
+		LOG("spi batched transfers not supported (errno %d). One chunk per transfer\n", errno);
+		dev->batch_transfers = 1;
+	}
+	else {
+		LOG("spi batched transfers : up to %d chunks per transfer\n", PLATFORM_BATCH_CHUNKS);
+		dev->batch_transfers = PLATFORM_BATCH_CHUNKS;
+	}
+}
+
+//
+// kernel_open
+//
+static void * kernel_open(const char * device, struct vd628x_backend_info * info)
+{
+	struct kernel_device *dev;
+	struct vd628x_spi_info spi_info;
+	int err;
+
+	dev = (struct kernel_device *)malloc(sizeof(struct kernel_device));
+	if (dev == NULL)
+		return NULL;
+
+	// the consumer position of the mapped ring is written by user space
+	// the ioctl transfers only need the device to be readable
+	dev->read_only = 0;
+	dev->fd = open(device, O_RDWR);
+	if ((dev->fd < 0) && (errno == EACCES)) {
+		dev->read_only = 1;
+		dev->fd = open(device, O_RDONLY);
+		if (dev->fd >= 0)
+			LOG("%s is read only. Chunks transferred by ioctl\n", device);
+	}
+	if (dev->fd < 0) {
+		LOG("FATAL error : Could not open %s\n", device);
+		free(dev);
+		return NULL;
+	}
+
+	// set read from device in non-blocking mode : the capture thread waits for
+	// the chunks with poll, so that it can be woken up by a pause or the stop
+	err = fcntl(dev->fd, F_SETFL, fcntl(dev->fd, F_GETFL, 0) | O_NONBLOCK);
+	if (err) {
+		LOG("ERROR : Could not set %s in non-blocking mode\n", device);
+		goto error;
+	}
+
+	err = ioctl(dev->fd, VD628x_IOCTL_GET_SPI_INFO, &spi_info);
+	if (err) {
+		LOG("FATAL error : error returned by VD628x_IOCTL_GET_SPI_INFO\n");
+		goto error;
+	}
+
+	// one or several chunks per transfer
+	probe_batch_transfers(dev);
+
+	info->chunk_size = spi_info.chunk_size;
+	info->spi_max_frequency = spi_info.spi_max_frequency;
+	info->batch_chunks = dev->batch_transfers;
+
+	return dev;
+
+error:
+	close(dev->fd);
+	free(dev);
+	return NULL;
+}
+
+//
+// kernel_configure
+//
+static int kernel_configure(void * context, const struct vd628x_spi_params * params)
+{
+	struct kernel_device *dev = context;
+
+	if (ioctl(dev->fd, VD628x_IOCTL_SET_SPI_PARAMS, params)) {
+		LOG("FATAL error : error returned by VD628x_IOCTL_SET_SPI_PARAMS\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+//
+// kernel_read_chunks
+// transfers up to chunks_nb chunks to samples, in one ioctl if the driver supports it
+// the device is non-blocking : returns the number of chunks transferred, 0 if no
+// chunk is ready, -1 on error
+//
+static int kernel_read_chunks(void * context, int16_t * samples, uint16_t chunks_nb)
+{
+	struct kernel_device *dev = context;
+	struct vd628x_chunks_samples chunks;
+	int ret;
+
+	if (dev->batch_transfers == 1) {
+		ret = ioctl(dev->fd, VD628x_IOCTL_GET_CHUNK_SAMPLES, samples);
+		chunks.chunks_nb = 1;
+	}
+	else {
+		chunks.samples = (__u64)(uintptr_t)samples;
+		chunks.chunks_nb = chunks_nb;
+		ret = ioctl(dev->fd, VD628x_IOCTL_GET_CHUNKS_SAMPLES, &chunks);
+	}
+
+	if (ret)
+		return (errno == EAGAIN) ? 0 : -1;
+
+	return chunks.chunks_nb;
+}
+
+//
+// kernel_poll_fd
+//
+static int kernel_poll_fd(void * context)
+{
+	struct kernel_device *dev = context;
+
+	return dev->fd;
+}
+
+//
+// kernel_map_ring
+// asks the driver to capture in a ring of chunks_nb chunks and maps it
+// a driver without ring rejects the request. not tried on a read only device
+//
+static int kernel_map_ring(void * context, uint32_t chunks_nb, struct vd628x_ring * ring)
+{
+	struct kernel_device *dev = context;
+	struct vd628x_ring_info info;
+
+	// the consumer position could not be written
+	if (dev->read_only)
+		return -1;
+
+	info.chunks_nb = chunks_nb;
+	if (ioctl(dev->fd, VD628x_IOCTL_SET_RING, &info)) {
+		LOG("spi sample ring not supported (errno %d). Chunks transferred by ioctl\n", errno);
+		return -1;
+	}
+
+	if (vd628x_ring_map(ring, dev->fd, info.map_size)) {
+		LOG("Error. Could not use the spi sample ring. Chunks transferred by ioctl\n");
+		info.chunks_nb = 0;
+		ioctl(dev->fd, VD628x_IOCTL_SET_RING, &info);
+		return -1;
+	}
+
+	return 0;
+}
+
+//
+// kernel_unmap_ring
+// stops the ring of the driver
+//
+static void kernel_unmap_ring(void * context, struct vd628x_ring * ring)
+{
+	struct kernel_device *dev = context;
+	struct vd628x_ring_info info;
+
+	vd628x_ring_unmap(ring);
+	info.chunks_nb = 0;
+	ioctl(dev->fd, VD628x_IOCTL_SET_RING, &info);
+}
+
+//
+// kernel_close
+//
+static void kernel_close(void * context)
+{
+	struct kernel_device *dev = context;
+
+	close(dev->fd);
+	free(dev);
+}
+
+const struct vd628x_backend vd628x_backend_kernel = {
+	NULL,
+	kernel_open,
+	kernel_configure,
+	kernel_read_chunks,
+	kernel_poll_fd,
+	NULL,
+	kernel_map_ring,
+	kernel_unmap_ring,
+	kernel_close
+};
@@ -0,0 +1,105 @@
+/********************************************************************************
+Copyright (c) 2025, STMicroelectronics - All Rights Reserved
+This file is licensed under open source license ST SLA0103
+********************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+
+#include "vd628x_clock_sync.h"
+
+#define LOG printf
+
+// a sync point this far from the model means the remote clock jumped : the
+// model restarts from it
+#define CLOCK_SYNC_RESET_NS 10000000
+// time covered by the sync points under which the skew is not fitted
+#define CLOCK_SYNC_MIN_SPAN_NS 100000000
+
+
+//
+// vd628x_clock_sync_init
+// remote_frequency is the nominal frequency of the remote clock in Hz
+//
+void vd628x_clock_sync_init(struct vd628x_clock_sync * cs, uint32_t remote_frequency)
+{
+	memset(cs, 0, sizeof(struct vd628x_clock_sync));
+	cs->nominal_skew = (double)remote_frequency / 1000000000;
+	cs->skew = cs->nominal_skew;
+}
+
+//
+// fit
+// least squares fit of the model on the sync points, relative to the last one
+// the nominal skew is kept while the points cover less than CLOCK_SYNC_MIN_SPAN_NS
+//
+static void fit(struct vd628x_clock_sync * cs, uint64_t local_last, uint64_t remote_last)
+{
+	double dx, dy, mx = 0, my = 0, sxx = 0, sxy = 0;
+	uint64_t oldest = local_last;
+	int i;
+
+	for (i = 0; i < cs->count; i++) {
+		mx += (double)(int64_t)(cs->local[i] - local_last);
+		my += (double)(int64_t)(cs->remote[i] - remote_last);
+		if (cs->local[i] < oldest)
+			oldest = cs->local[i];
+	}
+	mx /= cs->count;
+	my /= cs->count;
+
+	cs->skew = cs->nominal_skew;
+	if (local_last - oldest >= CLOCK_SYNC_MIN_SPAN_NS) {
+		for (i = 0; i < cs->count; i++) {
+			dx = (double)(int64_t)(cs->local[i] - local_last) - mx;
+			dy = (double)(int64_t)(cs->remote[i] - remote_last) - my;
+			sxx += dx * dx;
+			sxy += dx * dy;
+		}
+		cs->skew = sxy / sxx;
+	}
+
+	cs->local_ref = local_last;
+	cs->remote_ref = remote_last + (int64_t)llround(my - cs->skew * mx);
+}
+
+//
+// vd628x_clock_sync_add
+// adds the sync point : remote clock was remote at local_ns CLOCK_MONOTONIC time
+//
+void vd628x_clock_sync_add(struct vd628x_clock_sync * cs, uint64_t local_ns, uint64_t remote)
+{
+	int64_t error;
+
+	if (cs->count) {
+		error = (int64_t)(remote - vd628x_clock_sync_convert(cs, local_ns));
+		if ((remote < cs->remote[(cs->pos + CLOCK_SYNC_POINTS - 1) % CLOCK_SYNC_POINTS]) ||
+			(fabs(error / cs->skew) > CLOCK_SYNC_RESET_NS)) {
+			LOG("FLICKER : remote clock jumped by %" PRId64 " ticks, clock model restarted\n", error);
+			cs->count = 0;
+			cs->pos = 0;
+		}
+	}
+
+	cs->local[cs->pos] = local_ns;
+	cs->remote[cs->pos] = remote;
+	cs->pos = (cs->pos + 1) % CLOCK_SYNC_POINTS;
+	if (cs->count < CLOCK_SYNC_POINTS)
+		cs->count++;
+
+	fit(cs, local_ns, remote);
+}
+
+//
+// vd628x_clock_sync_convert
+// remote time of the local_ns CLOCK_MONOTONIC time. local_ns itself until a
+// sync point is added
+//
+uint64_t vd628x_clock_sync_convert(const struct vd628x_clock_sync * cs, uint64_t local_ns)
+{
+	if (cs->count == 0)
+		return local_ns;
+
+	return cs->remote_ref + (int64_t)((double)(int64_t)(local_ns - cs->local_ref) * cs->skew);
+}
@@ -0,0 +1,48 @@
+/********************************************************************************
+Copyright (c) 2025, STMicroelectronics - All Rights Reserved
+This file is licensed under open source license ST SLA0103
+********************************************************************************/
+#ifndef __VD628X_CLOCK_SYNC__
+#define __VD628X_CLOCK_SYNC__ 1
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// number of sync points the clock model is fitted on
+#ifndef CLOCK_SYNC_POINTS
+#define CLOCK_SYNC_POINTS 16
+#endif
+
+// QTimer frequency, used until two sync points give the actual rate
+#define CLOCK_SYNC_QTIMER_FREQUENCY 19200000
+
+//
+// vd628x_clock_sync
+// linear model of a remote clock against CLOCK_MONOTONIC, fitted on the last
+// CLOCK_SYNC_POINTS sync points : remote = remote_ref + skew * (local - local_ref)
+//
+struct vd628x_clock_sync {
+	// sync points, oldest first from pos once the window is full
+	uint64_t local[CLOCK_SYNC_POINTS];
+	uint64_t remote[CLOCK_SYNC_POINTS];
+	uint8_t pos;
+	uint8_t count;
+	// model
+	uint64_t local_ref;
+	uint64_t remote_ref;
+	double skew;          // remote ticks per local ns
+	double nominal_skew;
+};
+
+void vd628x_clock_sync_init(struct vd628x_clock_sync * cs, uint32_t remote_frequency);
+void vd628x_clock_sync_add(struct vd628x_clock_sync * cs, uint64_t local_ns, uint64_t remote);
+uint64_t vd628x_clock_sync_convert(const struct vd628x_clock_sync * cs, uint64_t local_ns);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -4,98 +4,672 @@ This file is licensed under open source license ST SLA0103
 ********************************************************************************/
 #include "vd628x_fft_utils.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
 
 #define LOG printf
 
-void perform_fft(int16_t *flk, float complex *ffti, float complex *ffto, int nb, int is_dc_remove)
+#ifdef FFT_REAL_INPUT_CHECK
+//
+// check_real_fft
+// debug function running the complex fft on the same samples as the real fft
+// and comparing both half spectrums. Operations are not done in the same order
+// so results can not be bit exact : the peak bins must match and the error must
+// stay at float rounding level
+//
+static void check_real_fft(int16_t *flk, float complex *ffto, int nb, int nb_valid, float dc)
 {
-	int i;
-	float dc = 0;
+	float complex *ref_in, *ref_out;
+	float max_err = 0, max_abs = 0;
+	int i, peak = 0, ref_peak = 0;
 
-	if (is_dc_remove) {
-		for(i = 0; i < nb; i++)
-			dc += flk[i];
-		dc = dc / nb;
+	ref_in = (float complex *)malloc(nb*sizeof(float complex));
+	ref_out = (float complex *)malloc(nb*sizeof(float complex));
+	if ((ref_in == NULL) || (ref_out == NULL)) {
+		free(ref_in);
+		free(ref_out);
+		return;
 	}
 
 	for(i = 0; i < nb; i++)
-		ffti[i] = flk[i] - dc;
+		ref_in[i] = (i < nb_valid) ? flk[i] - dc : 0;
+	fft(ref_in, ref_out, nb);
+
+	for(i = 1; i < nb/2; i++) {
+		if (cabsf(ref_out[i] - ffto[i]) > max_err)
+			max_err = cabsf(ref_out[i] - ffto[i]);
+		if (cabsf(ref_out[i]) > cabsf(ref_out[ref_peak]))
+			ref_peak = i;
+		if (cabsf(ffto[i]) > cabsf(ffto[peak]))
+			peak = i;
+	}
+	max_abs = cabsf(ref_out[ref_peak]);
+
+	if ((peak != ref_peak) || (max_err > 1e-5f * max_abs))
+		LOG("FFT_REAL_INPUT_CHECK mismatch : peak %d vs %d, max error %e for max amplitude %e\n", peak, ref_peak, max_err, max_abs);
+
+	free(ref_in);
+	free(ref_out);
+}
+#endif
+
+//
+// perform_fft
+// only the nb_valid first samples are real ones, the other ones are the zeros
+// of the zero padding trick : they are neither converted nor used by the
+// first fft stages (input-pruned fft)
+// only bins bin_first to bin_last are searched afterwards. when the band is
+// narrow enough, they are computed by a partial dft instead of the fft and
+// the other bins of ffto are left untouched
+// dc is subtracted from the samples while they are converted
+// window holds the nb coefficients of a window (see create_window), applied to
+// the samples in the same loop. the window spans the valid samples :
+// the periodic window of nb_valid = nb/s points is one coefficient out of s.
+// NULL is the rectangular window
+//
+void perform_fft(int16_t *flk, float complex *ffti, float complex *ffto, int nb, int nb_valid, float dc, const float *window, int bin_first, int bin_last)
+{
+	int i;
+	int is_partial_dft = fft_dft_is_cheaper(nb, nb_valid, bin_last - bin_first + 1);
+	int ws = nb / nb_valid;
+	int nb_samples = nb_valid;
+
+	if (is_partial_dft) {
+		// ffti is used as an array of real samples
+		float *x = (float *)ffti;
+
+		if (window)
+			for(i = 0; i < nb_valid; i++)
+				x[i] = (flk[i] - dc) * window[i*ws];
+		else
+			for(i = 0; i < nb_valid; i++)
+				x[i] = flk[i] - dc;
+
+		fft_dft_real_bins(fft_plan_create(nb), x, nb_valid, ffto, bin_first, bin_last);
+		return;
+	}
+
+	// the zeros of the zero padding are not converted : dc must not be subtracted from them
+#ifdef FFT_REAL_INPUT
+	if (window)
+		for(i = 0; i < nb_samples/2; i++)
+			ffti[i] = (flk[2*i] - dc) * window[2*i*ws] + I*(flk[2*i+1] - dc) * window[(2*i+1)*ws];
+	else
+		for(i = 0; i < nb_samples/2; i++)
+			ffti[i] = (flk[2*i] - dc) + I*(flk[2*i+1] - dc);
+	for(; i < (nb_valid+1)/2; i++)
+		ffti[i] = 0;
+
+	fft_real_execute_pruned(fft_plan_create(nb), ffti, ffto, nb_valid);
+#ifdef FFT_REAL_INPUT_CHECK
+	if (window == NULL)
+		check_real_fft(flk, ffto, nb, nb_samples, dc);
+#endif
+#else
+	if (window)
+		for(i = 0; i < nb_samples; i++)
+			ffti[i] = (flk[i] - dc) * window[i*ws];
+	else
+		for(i = 0; i < nb_samples; i++)
+			ffti[i] = flk[i] - dc;
+	for(; i < nb_valid; i++)
+		ffti[i] = 0;
+
+	fft_execute_pruned(fft_plan_create(nb), ffti, ffto, nb_valid);
+#endif
+}
+
+//
+// peak search
+// a bin is a peak when its power is higher than the one of its left neighbour
+// and not lower than the one of its right neighbour (first bin of a plateau).
+// bins out of [bin_first, bin_last] are not neighbours. the adjacent bins of
+// a lobe are thus suppressed and only its maximum competes for the k places
+//
+#define PEAK_BLOCK 64
+
+struct flk_peak {
+	float power;
+	int index;
+	// sub-bin position of the peak, see peak_offset
+	float offset;
+};
+
+// true if peak a ranks lower than peak b : lower power, or same power and higher bin
+static inline int peak_is_lower(const struct flk_peak *a, const struct flk_peak *b)
+{
+	return (a->power < b->power) || ((a->power == b->power) && (a->index > b->index));
+}
+
+//
+// peak_heap_push
+// heap is a min-heap of n (at most k) peaks, its root is the lowest of the best peaks
+//
+static void peak_heap_push(struct flk_peak *heap, int *n, int k, float power, int index)
+{
+	struct flk_peak peak = { power, index, 0 };
+	int i, child;
+
+	if (*n < k) {
+		// sift up
+		for (i = (*n)++; (i > 0) && peak_is_lower(&peak, &heap[(i-1)/2]); i = (i-1)/2)
+			heap[i] = heap[(i-1)/2];
+		heap[i] = peak;
+		return;
+	}
+
+	if (!peak_is_lower(&heap[0], &peak))
+		return;
+
+	// replace the root and sift down
+	for (i = 0; (child = 2*i+1) < *n; i = child) {
+		if ((child+1 < *n) && peak_is_lower(&heap[child+1], &heap[child]))
+			child++;
+		if (!peak_is_lower(&heap[child], &peak))
+			break;
+		heap[i] = heap[child];
+	}
+	heap[i] = peak;
+}
+
+//
+// scan_block
+// power[j] is the power of bin lo+j. tests bins b to end-1 (lo is b-1 or b)
+//
+static void scan_block(const float *power, int lo, int b, int end, int bin_first, int bin_last, struct flk_peak *heap, int *n, int k)
+{
+	int i;
+
+	for (i = b; i < end; i++) {
+		float p = power[i-lo];
+
+		if ((i > bin_first) && (p <= power[i-1-lo]))
+			continue;
+		if ((i < bin_last) && (p < power[i+1-lo]))
+			continue;
+		peak_heap_push(heap, n, k, p, i);
+	}
+}
+
+//
+// sort_peaks
+// sorts the peaks of the heap by decreasing power, insertion sort as k is small
+//
+static void sort_peaks(struct flk_peak *peaks, int n)
+{
+	int i, j;
 
-	fft(ffti, ffto, nb);
+	for (i = 1; i < n; i++) {
+		struct flk_peak peak = peaks[i];
+
+		for (j = i; (j > 0) && peak_is_lower(&peaks[j-1], &peak); j--)
+			peaks[j] = peaks[j-1];
+		peaks[j] = peak;
+	}
+}
+
+//
+// peak_offset
+// position of the true peak relative to bin k, in [-0.5, 0.5] bin, from the
+// bins a = X[k-1], b = X[k] and c = X[k+1]
+// without zero padding, the lobe of the rectangular window is sampled once
+// per bin and Jacobsen's estimator, an approximation with a small bias for a
+// pure tone, is used :
+//   -Re((c - a) / (2b - a - c))
+// with zero padding (nb_valid < nb) or a window other than the rectangular one,
+// bins oversample the lobe and the peak of the parabola through the 3 magnitudes
+// is more accurate
+// (host simulation, tone in 50-1000 Hz, fe = nb = 2048, rms error :
+//  Jacobsen 0.001 bin at 1 s, parabola 0.01 to 0.02 bin at 0.25 and 0.5 s)
+//
+static float peak_offset(float complex a, float complex b, float complex c, int is_oversampled)
+{
+	float delta = 0;
+
+	if (is_oversampled) {
+		float ma = cabsf(a), mb = cabsf(b), mc = cabsf(c);
+		float den = ma - 2 * mb + mc;
+
+		if (den != 0)
+			delta = 0.5f * (ma - mc) / den;
+	}
+	else {
+		float complex den = 2 * b - a - c;
+
+		if (den != 0)
+			delta = -crealf((c - a) / den);
+	}
+
+	if (delta > 0.5f)
+		delta = 0.5f;
+	if (delta < -0.5f)
+		delta = -0.5f;
+
+	return delta;
+}
+
+//
+// set_peak_results
+// sets the results from the peaks sorted by decreasing power, square root is
+// only taken for the k peaks. missing peaks count as bin 0 with amplitude -1/nb
+// if frequencies is not NULL, peak indexes are indexes in this table of
+// frequencies in Hz instead of bins
+//
+static void set_peak_results(
+		struct flk_peak *peaks,
+		int n,
+		int k,
+		int fe,
+		int nb,
+		int exponent,
+		const float *frequencies,
+		float * firstMaximaPeakFrequency,
+		float * firstMaximaPeakAmplitude,
+		float * SecondMaximaPeakFrequency,
+		float * SecondMaximaPeakAmplitude,
+		float * avgHighestAmplitude)
+{
+	float frequency[FLK_PEAKS_MAX];
+	float max_value[FLK_PEAKS_MAX];
+	float sum = 0;
+	int i;
+
+	for (i = 0; i < k; i++) {
+		if (i >= n)
+			frequency[i] = 0;
+		else if (frequencies)
+			frequency[i] = frequencies[peaks[i].index];
+		else
+			frequency[i] = ((peaks[i].index + peaks[i].offset) * fe) / nb;
+		max_value[i] = (i < n) ? ldexpf(sqrtf(peaks[i].power), exponent) : -1;
+		sum += max_value[i]/nb;
+	}
+
+	*firstMaximaPeakFrequency = frequency[0];
+	*firstMaximaPeakAmplitude = max_value[0]/nb;
+	*SecondMaximaPeakFrequency = (k > 1) ? frequency[1] : 0;
+	*SecondMaximaPeakAmplitude = (k > 1) ? max_value[1]/nb : -1.0f/nb;
+	*avgHighestAmplitude = sum / k;
 }
 
+//
+// find_flk_freq_2
+// peaks are searched from bin bin_first to bin_last (included), which must be
+// within 1 and nb/2-1, in a single pass over the squared magnitudes
+// k (1 to FLK_PEAKS_MAX) is the number of highest peaks averaged into avgHighestAmplitude
+// the frequencies of the first and second peaks are interpolated between bins.
+// nb_valid is the number of samples before zero padding, is_windowed is non zero
+// if the samples were not taken through the rectangular window
+//
 void find_flk_freq_2(
 		int fe,
 		float complex *ffto,
 		int nb,
+		int nb_valid,
+		int is_windowed,
+		int bin_first,
+		int bin_last,
+		int k,
 		float * firstMaximaPeakFrequency,
 		float * firstMaximaPeakAmplitude,
 		float * SecondMaximaPeakFrequency,
 		float * SecondMaximaPeakAmplitude,
-		float * avgFiveHighestAmplitude)
+		float * avgHighestAmplitude)
 {
 #ifdef LOG_FFT
 	static uint32_t count=0;
 #endif
-	int index_max[5] = {0,0,0,0,0};
-	float max_value[5] = {-1,-1,-1,-1,-1};
+	struct flk_peak peaks[FLK_PEAKS_MAX];
+	float power[PEAK_BLOCK + 2];
+	int n = 0;
+	int b, i;
 
-	int i;
+	if (k > FLK_PEAKS_MAX)
+		k = FLK_PEAKS_MAX;
+	if (k < 1)
+		k = 1;
 
-	for(i=1; i < nb / 2; i++) {
-		if (cabsf(ffto[i]) > max_value[0]) {
-			index_max[0] = i;
-			max_value[0] = cabsf(ffto[i]);
-		}
+	// the powers of a block and of its two neighbours are computed first (vectorizable loop)
+	for (b = bin_first; b <= bin_last; b += PEAK_BLOCK) {
+		int end = (b + PEAK_BLOCK <= bin_last) ? b + PEAK_BLOCK : bin_last + 1;
+		int lo = (b > bin_first) ? b - 1 : b;
+		int hi = (end <= bin_last) ? end : bin_last;
+
+		for (i = lo; i <= hi; i++)
+			power[i-lo] = crealf(ffto[i]) * crealf(ffto[i]) + cimagf(ffto[i]) * cimagf(ffto[i]);
+
+		scan_block(power, lo, b, end, bin_first, bin_last, peaks, &n, k);
 	}
-	for(i=1; i < nb / 2; i++) {
-		if ((cabsf(ffto[i]) > max_value[1]) &&
-				(cabsf(ffto[i]) != max_value[0])) {
-			index_max[1] = i;
-			max_value[1] = cabsf(ffto[i]);
-		}
+
+#ifdef LOG_FFT
+	for (i=bin_first; i <= bin_last; i++) {
+		LOG("fft,%d,%d,%d,%f\n",count,fe,i*fe/nb, cabsf(ffto[i]/nb));
 	}
-	for(i=1; i < nb / 2; i++) {
-		if ((cabsf(ffto[i]) > max_value[2]) &&
-				(cabsf(ffto[i]) != max_value[0]) &&
-				(cabsf(ffto[i]) != max_value[1])
-				) {
-			index_max[2] = i;
-			max_value[2] = cabsf(ffto[i]);
-		}
+	count++;
+#endif
+	sort_peaks(peaks, n);
+	for (i = 0; (i < n) && (i < 2); i++) {
+		int p = peaks[i].index;
+
+		// neighbours out of the band may not be computed (partial dft)
+		if ((p > bin_first) && (p < bin_last))
+			peaks[i].offset = peak_offset(ffto[p-1], ffto[p], ffto[p+1], (nb_valid < nb) || is_windowed);
 	}
-	for(i=1; i < nb / 2; i++) {
-		if ((cabsf(ffto[i]) > max_value[3]) &&
-				(cabsf(ffto[i]) != max_value[0]) &&
-				(cabsf(ffto[i]) != max_value[1]) &&
-				(cabsf(ffto[i]) != max_value[2])
-				) {
-			index_max[3] = i;
-			max_value[3] = cabsf(ffto[i]);
+
+	set_peak_results(peaks, n, k, fe, nb, 0, NULL,
+		firstMaximaPeakFrequency,
+		firstMaximaPeakAmplitude,
+		SecondMaximaPeakFrequency,
+		SecondMaximaPeakAmplitude,
+		avgHighestAmplitude);
+}
+
+
+//
+// find_flk_freq_q15
+// same peak search as find_flk_freq_2 on the spectrum produced in place by fft_q15_real
+// (full transform, the search only covers bins bin_first to bin_last)
+// bins are nb/2 interleaved Q15 complex values scaled by 2^exponent
+// powers are computed exactly on 32 bits then ranked as floats
+//
+void find_flk_freq_q15(
+		int fe,
+		int16_t *spectrum,
+		int exponent,
+		int nb,
+		int nb_valid,
+		int is_windowed,
+		int bin_first,
+		int bin_last,
+		int k,
+		float * firstMaximaPeakFrequency,
+		float * firstMaximaPeakAmplitude,
+		float * SecondMaximaPeakFrequency,
+		float * SecondMaximaPeakAmplitude,
+		float * avgHighestAmplitude)
+{
+	struct flk_peak peaks[FLK_PEAKS_MAX];
+	float power[PEAK_BLOCK + 2];
+	int n = 0;
+	int b, i;
+
+	if (k > FLK_PEAKS_MAX)
+		k = FLK_PEAKS_MAX;
+	if (k < 1)
+		k = 1;
+
+	for (b = bin_first; b <= bin_last; b += PEAK_BLOCK) {
+		int end = (b + PEAK_BLOCK <= bin_last) ? b + PEAK_BLOCK : bin_last + 1;
+		int lo = (b > bin_first) ? b - 1 : b;
+		int hi = (end <= bin_last) ? end : bin_last;
+
+		for (i = lo; i <= hi; i++) {
+			int32_t re = spectrum[2*i];
+			int32_t im = spectrum[2*i+1];
+
+			power[i-lo] = (float)((uint32_t)(re * re) + (uint32_t)(im * im));
 		}
+
+		scan_block(power, lo, b, end, bin_first, bin_last, peaks, &n, k);
 	}
-	for(i=1; i < nb / 2; i++) {
-		if ((cabsf(ffto[i]) > max_value[4]) &&
-				(cabsf(ffto[i]) != max_value[0]) &&
-				(cabsf(ffto[i]) != max_value[1]) &&
-				(cabsf(ffto[i]) != max_value[2]) &&
-				(cabsf(ffto[i]) != max_value[3])
-				) {
-			index_max[4] = i;
-			max_value[4] = cabsf(ffto[i]);
+
+	// interpolation only uses ratios of bins : the exponent is not needed
+	sort_peaks(peaks, n);
+	for (i = 0; (i < n) && (i < 2); i++) {
+		int p = peaks[i].index;
+
+		if ((p > bin_first) && (p < bin_last))
+			peaks[i].offset = peak_offset(
+				spectrum[2*(p-1)] + I*spectrum[2*(p-1)+1],
+				spectrum[2*p] + I*spectrum[2*p+1],
+				spectrum[2*(p+1)] + I*spectrum[2*(p+1)+1],
+				(nb_valid < nb) || is_windowed);
+	}
+
+	set_peak_results(peaks, n, k, fe, nb, exponent, NULL,
+		firstMaximaPeakFrequency,
+		firstMaximaPeakAmplitude,
+		SecondMaximaPeakFrequency,
+		SecondMaximaPeakAmplitude,
+		avgHighestAmplitude);
+}
+
+
+//
+// find_flk_freq_goertzel
+// evaluates the spectrum at the given frequencies only, with a bank of Goertzel
+// filters run directly on the nb_valid samples of flk, dc being subtracted on the fly.
+// frequencies need not fall on bins, those at or above fe/2 are ignored
+// results are the same as find_flk_freq_2 restricted to these frequencies :
+// amplitudes are |X(f)|/nb, nb being the zero padded fft size
+//
+// the recurrence s[n] = x[n] + 2.cos(w).s[n-1] - s[n-2] is latency bound, so
+// each vector of GOERTZEL_LANES frequencies runs on GOERTZEL_SEGMENTS
+// interleaved parts of the samples, whose dfts are summed once rotated to
+// their start : for a part of len samples starting at n0
+//   X(f) = exp(-i.w.(n0 + len - 1)) . (s[len-1] - exp(-i.w).s[len-2])
+//
+#define GOERTZEL_LANES 4
+#define GOERTZEL_SEGMENTS 4
+
+typedef float goertzel_vector __attribute__((vector_size(GOERTZEL_LANES * sizeof(float))));
+
+void find_flk_freq_goertzel(
+		int fe,
+		const int16_t *flk,
+		float dc,
+		int nb,
+		int nb_valid,
+		const float *frequencies,
+		int frequencies_nb,
+		int k,
+		float * firstMaximaPeakFrequency,
+		float * firstMaximaPeakAmplitude,
+		float * SecondMaximaPeakFrequency,
+		float * SecondMaximaPeakAmplitude,
+		float * avgHighestAmplitude)
+{
+	struct flk_peak peaks[FLK_PEAKS_MAX];
+	int len = nb_valid / GOERTZEL_SEGMENTS;
+	int n = 0;
+	int f0, i, j, g;
+
+	if (k > FLK_PEAKS_MAX)
+		k = FLK_PEAKS_MAX;
+	if (k < 1)
+		k = 1;
+
+	for (f0 = 0; f0 < frequencies_nb; f0 += GOERTZEL_LANES) {
+		goertzel_vector c, s1[GOERTZEL_SEGMENTS], s2[GOERTZEL_SEGMENTS];
+		int lanes = (frequencies_nb - f0 < GOERTZEL_LANES) ? frequencies_nb - f0 : GOERTZEL_LANES;
+
+		for (j = 0; j < GOERTZEL_LANES; j++)
+			c[j] = (j < lanes) ? 2 * cosf(2 * (float)M_PI * frequencies[f0+j] / fe) : 0;
+		for (g = 0; g < GOERTZEL_SEGMENTS; g++) {
+			s1[g] = c - c;
+			s2[g] = c - c;
+		}
+
+		for (i = 0; i < len; i++) {
+			for (g = 0; g < GOERTZEL_SEGMENTS; g++) {
+				float x = flk[g * len + i] - dc;
+				goertzel_vector xv = { x, x, x, x };
+				goertzel_vector s0 = c * s1[g] + (xv - s2[g]);
+
+				s2[g] = s1[g];
+				s1[g] = s0;
+			}
+		}
+
+		// the last part also takes the remaining samples
+		g = GOERTZEL_SEGMENTS - 1;
+		for (i = GOERTZEL_SEGMENTS * len; i < nb_valid; i++) {
+			float x = flk[i] - dc;
+			goertzel_vector xv = { x, x, x, x };
+			goertzel_vector s0 = c * s1[g] + (xv - s2[g]);
+
+			s2[g] = s1[g];
+			s1[g] = s0;
+		}
+
+		for (j = 0; j < lanes; j++) {
+			// phases are reduced in turns so that float precision is not lost on large n
+			double turns = (double)frequencies[f0+j] / fe;
+			float complex w = cexpf(-2 * I * (float)M_PI * fmod(turns, 1.0));
+			float complex rotation = cexpf(-2 * I * (float)M_PI * fmod(turns * (len - 1), 1.0));
+			float complex step = cexpf(-2 * I * (float)M_PI * fmod(turns * len, 1.0));
+			float complex X = 0;
+
+			if ((frequencies[f0+j] <= 0) || (2 * frequencies[f0+j] >= fe))
+				continue;
+
+			for (g = 0; g < GOERTZEL_SEGMENTS; g++) {
+				if (g == GOERTZEL_SEGMENTS - 1)
+					rotation = cexpf(-2 * I * (float)M_PI * fmod(turns * (nb_valid - 1), 1.0));
+				X += rotation * (s1[g][j] - w * s2[g][j]);
+				rotation *= step;
+			}
+			peak_heap_push(peaks, &n, k, crealf(X) * crealf(X) + cimagf(X) * cimagf(X), f0 + j);
 		}
 	}
 
-#ifdef LOG_FFT
-	for (i=1; i < nb / 2; i++) {
-		LOG("fft,%d,%d,%d,%f\n",count,fe,i*fe/nb, cabsf(ffto[i]/nb));
+	sort_peaks(peaks, n);
+	set_peak_results(peaks, n, k, fe, nb, 0, frequencies,
+		firstMaximaPeakFrequency,
+		firstMaximaPeakAmplitude,
+		SecondMaximaPeakFrequency,
+		SecondMaximaPeakAmplitude,
+		avgHighestAmplitude);
+}
+
+
+//
+// create_window
+// periodic cosine-sum window of nb points, w[i] = sum of (-1)^j.a[j].cos(2.pi.j.i/nb)
+// coefficients are divided by the coherent gain of the window (its mean, a[0]) so
+// that the amplitude of a tone is the same as through the rectangular window.
+// the coherent gain is returned in coherent_gain.
+// returns NULL for FFT_WINDOW_RECTANGULAR, which needs no coefficient
+//
+float *create_window(int type, int nb, float *coherent_gain)
+{
+	static const double coefficients[][5] = {
+		[FFT_WINDOW_HANN] = { 0.5, 0.5 },
+		[FFT_WINDOW_BLACKMAN_HARRIS] = { 0.35875, 0.48829, 0.14128, 0.01168 },
+		[FFT_WINDOW_FLAT_TOP] = { 0.21557895, 0.41663158, 0.277263158, 0.083578947, 0.006947368 },
+	};
+	const double *a;
+	float *window;
+	int i, j;
+
+	*coherent_gain = 1;
+	if ((type <= FFT_WINDOW_RECTANGULAR) || (type > FFT_WINDOW_FLAT_TOP))
+		return NULL;
+
+	window = (float *)malloc(nb * sizeof(float));
+	if (window == NULL)
+		return NULL;
+
+	a = coefficients[type];
+	for (i = 0; i < nb; i++) {
+		double w = 0;
+
+		for (j = 0; j < 5; j++)
+			w += ((j & 1) ? -a[j] : a[j]) * cos(2 * M_PI * j * i / nb);
+		window[i] = (float)(w / a[0]);
+	}
+	*coherent_gain = (float)a[0];
+
+	return window;
+}
+
+//
+// welch_accumulate
+// running average of the power spectrum, bins bin_first to bin_last
+// power[i] becomes the mean of the n last spectra for the n first calls,
+// then an exponential average of time constant n spectra
+// n == 1 starts a new average : the previous content of power is not read
+// gain scales the powers
+//
+void welch_accumulate(float *power, const float complex *ffto, int bin_first, int bin_last, int n, float gain)
+{
+	float alpha = 1.0f / n;
+	int i;
+
+	for (i = bin_first; i <= bin_last; i++) {
+		float p = (crealf(ffto[i]) * crealf(ffto[i]) + cimagf(ffto[i]) * cimagf(ffto[i])) * gain;
+
+		if (n == 1)
+			power[i] = p;
+		else
+			power[i] += (p - power[i]) * alpha;
+	}
+}
+
+//
+// welch_accumulate_q15
+// same as welch_accumulate on the spectrum produced in place by fft_q15_real
+//
+void welch_accumulate_q15(float *power, const int16_t *spectrum, int exponent, int bin_first, int bin_last, int n, float gain)
+{
+	float alpha = 1.0f / n;
+	int i;
+
+	gain = ldexpf(gain, 2 * exponent);
+	for (i = bin_first; i <= bin_last; i++) {
+		int32_t re = spectrum[2*i];
+		int32_t im = spectrum[2*i+1];
+		float p = (float)((uint32_t)(re * re) + (uint32_t)(im * im)) * gain;
+
+		if (n == 1)
+			power[i] = p;
+		else
+			power[i] += (p - power[i]) * alpha;
 	}
-	count++;
-#endif
-	*firstMaximaPeakFrequency = (index_max[0] * fe) / nb;
-	*firstMaximaPeakAmplitude = max_value[0]/nb;
-	*SecondMaximaPeakFrequency = (index_max[1] * fe) / nb;
-	*SecondMaximaPeakAmplitude = max_value[1]/nb;
-	*avgFiveHighestAmplitude =   (*firstMaximaPeakAmplitude + *SecondMaximaPeakAmplitude + max_value[2]/nb + max_value[3]/nb +max_value[4]/nb)/5;
 }
 
+//
+// find_flk_freq_welch
+// same peak search as find_flk_freq_2 on the averaged power spectrum of welch_accumulate
+// power is indexed by bin. the phases are lost by the average : the first
+// and second peaks are interpolated with the parabola through the magnitudes
+//
+void find_flk_freq_welch(
+		int fe,
+		const float *power,
+		int nb,
+		int bin_first,
+		int bin_last,
+		int k,
+		float * firstMaximaPeakFrequency,
+		float * firstMaximaPeakAmplitude,
+		float * SecondMaximaPeakFrequency,
+		float * SecondMaximaPeakAmplitude,
+		float * avgHighestAmplitude)
+{
+	struct flk_peak peaks[FLK_PEAKS_MAX];
+	int n = 0;
+	int i;
+
+	if (k > FLK_PEAKS_MAX)
+		k = FLK_PEAKS_MAX;
+	if (k < 1)
+		k = 1;
+
+	scan_block(power, 0, bin_first, bin_last + 1, bin_first, bin_last, peaks, &n, k);
+
+	sort_peaks(peaks, n);
+	for (i = 0; (i < n) && (i < 2); i++) {
+		int p = peaks[i].index;
+
+		if ((p > bin_first) && (p < bin_last))
+			peaks[i].offset = peak_offset(sqrtf(power[p-1]), sqrtf(power[p]), sqrtf(power[p+1]), 1);
+	}
+
+	set_peak_results(peaks, n, k, fe, nb, 0, NULL,
+		firstMaximaPeakFrequency,
+		firstMaximaPeakAmplitude,
+		SecondMaximaPeakFrequency,
+		SecondMaximaPeakAmplitude,
+		avgHighestAmplitude);
+}
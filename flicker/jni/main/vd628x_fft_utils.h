@@ -7,16 +7,92 @@ This file is licensed under open source license ST SLA0103
 
 #include <stdint.h>
 #include "fft.h"
+#include "fft-q15.h"
 
-void perform_fft(int16_t *flk, float complex *ffti, float complex *ffto, int nb, int is_dc_remove);
+// number of complex values in the fft input and output buffers for nb samples.
+// with FFT_REAL_INPUT, nb real samples are packed into nb/2 complex values
+// and only the first half of the spectrum (the one that is searched) is produced
+#ifdef FFT_REAL_INPUT
+#define FFT_BUFFER_NB(nb) ((nb)/2)
+#else
+#define FFT_BUFFER_NB(nb) (nb)
+#endif
+
+// number of highest peaks averaged into avgFlickerFreqAmplitude
+// and maximum number of peaks find_flk_freq_2 and find_flk_freq_q15 can keep
+#ifndef FLK_PEAKS_NB
+#define FLK_PEAKS_NB 5
+#endif
+#define FLK_PEAKS_MAX 16
+
+// window functions of create_window
+#define FFT_WINDOW_RECTANGULAR 0
+#define FFT_WINDOW_HANN 1
+#define FFT_WINDOW_BLACKMAN_HARRIS 2
+#define FFT_WINDOW_FLAT_TOP 3
+
+void perform_fft(int16_t *flk, float complex *ffti, float complex *ffto, int nb, int nb_valid, float dc, const float *window, int bin_first, int bin_last);
 
 void find_flk_freq_2(
 		int fe,
 		float complex *ffto,
 		int nb,
+		int nb_valid,
+		int is_windowed,
+		int bin_first,
+		int bin_last,
+		int k,
+		float * firstMaximaFrequency,
+		float * firstMaximaAmplitude,
+		float * SecondMaximaFrequency,
+		float * SecondMaximaAmplitude,
+		float * avgHighestAmplitude);
+
+void find_flk_freq_q15(
+		int fe,
+		int16_t *spectrum,
+		int exponent,
+		int nb,
+		int nb_valid,
+		int is_windowed,
+		int bin_first,
+		int bin_last,
+		int k,
+		float * firstMaximaFrequency,
+		float * firstMaximaAmplitude,
+		float * SecondMaximaFrequency,
+		float * SecondMaximaAmplitude,
+		float * avgHighestAmplitude);
+
+void find_flk_freq_goertzel(
+		int fe,
+		const int16_t *flk,
+		float dc,
+		int nb,
+		int nb_valid,
+		const float *frequencies,
+		int frequencies_nb,
+		int k,
+		float * firstMaximaFrequency,
+		float * firstMaximaAmplitude,
+		float * SecondMaximaFrequency,
+		float * SecondMaximaAmplitude,
+		float * avgHighestAmplitude);
+
+float *create_window(int type, int nb, float *coherent_gain);
+void welch_accumulate(float *power, const float complex *ffto, int bin_first, int bin_last, int n, float gain);
+void welch_accumulate_q15(float *power, const int16_t *spectrum, int exponent, int bin_first, int bin_last, int n, float gain);
+
+void find_flk_freq_welch(
+		int fe,
+		const float *power,
+		int nb,
+		int bin_first,
+		int bin_last,
+		int k,
 		float * firstMaximaFrequency,
 		float * firstMaximaAmplitude,
 		float * SecondMaximaFrequency,
 		float * SecondMaximaAmplitude,
-		float * avgFiveHighestAmplitude);
+		float * avgHighestAmplitude);
 #endif
@@ -13,9 +13,12 @@ This file is licensed under open source license ST SLA0103
 #include <inttypes.h>
 #include <complex.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <math.h>
 
 #include "vd628x_platform.h"
 #include "vd628x_fft_utils.h"
+#include "fft-simd.h"
 
 #include "vd628x_flk_detect.h"
 
@@ -30,13 +33,29 @@ This file is licensed under open source license ST SLA0103
 struct vd628x_flk_detect_info {
 	// flicker detect thread
 	pthread_t flicker_detect_thread;
-	uint8_t flicker_detect_runs;
+	atomic_int flicker_detect_runs;
+	// 1 : the flicker detect thread stopped on error, see vd628x_flickerDetectFailed
+	atomic_int flicker_detect_error;
 	// buffers for flicker detect
 	int samplingFrequency;
 	int newSamplingFrequency;
+	// detection settings and settings to apply after the current fft
+	// newSamplingFrequency, newConfig and newConfigAvailable are written by the api
+	// thread and read by the flicker detect thread under config_mutex
+	struct vd628x_flk_detect_config config;
+	struct vd628x_flk_detect_config newConfig;
+	uint8_t newConfigAvailable;
+	pthread_mutex_t config_mutex;
+	// samples of the window being analysed, in a platform capture buffer
 	int16_t * flk_data;
 	float complex * fft_in;
 	float complex * fft_out;
+	// window table for samplingFrequency points (NULL : rectangular) and its coherent gain
+	float * window;
+	float window_gain;
+	// welch mode : averaged power spectrum and number of spectra in it
+	float * welch_power;
+	uint16_t welch_n;
 	// platform client
 	void * client;
 	// STALS handle
@@ -52,45 +71,271 @@ struct vd628x_flk_detect_info {
 static struct vd628x_flk_detect_info * pFLKDI = NULL;
 
 
+//
+// update_window
+// builds the table of the configured window function for the current sampling frequency
+// welch mode needs a taper : the rectangular window is replaced by the Hann window
+//
+static int update_window()
+{
+	// FLK_WINDOW_xxx values are the FFT_WINDOW_xxx ones
+	int type = pFLKDI->config.window;
+
+	if ((pFLKDI->config.mode == FLK_DETECT_MODE_WELCH) && (type == FFT_WINDOW_RECTANGULAR))
+		type = FFT_WINDOW_HANN;
+
+	free(pFLKDI->window);
+	pFLKDI->window = create_window(type, pFLKDI->samplingFrequency, &pFLKDI->window_gain);
+	if ((pFLKDI->window == NULL) && (type != FFT_WINDOW_RECTANGULAR))
+		return -1;
+
+	return 0;
+}
+
+//
+// free_fft_resources
+// disallocation of resources needed for fft to be performed
+// the pointers are cleared : it can be called again, by vd628x_flickerDetectStop
+//
+static void free_fft_resources() {
+
+	free(pFLKDI->fft_in);
+	pFLKDI->fft_in = NULL;
+	free(pFLKDI->fft_out);
+	pFLKDI->fft_out = NULL;
+	free(pFLKDI->window);
+	pFLKDI->window = NULL;
+	free(pFLKDI->welch_power);
+	pFLKDI->welch_power = NULL;
+}
+
 //
 // allocate_fft_resources
 // allocation of resources needed for fft to be performed
 //
 static int allocate_fft_resources() {
 
-	// malloc data for fft and reset to 0 all samples so that 1Hz accuracy
-	//can be worked with less that 1 second of samples
-	pFLKDI->flk_data = (int16_t *)calloc(pFLKDI->samplingFrequency, sizeof(int16_t));
-	if (pFLKDI->flk_data == NULL) {
+	// welch mode can be selected at any time : its buffer is always allocated
+	pFLKDI->welch_power = (float *)malloc(pFLKDI->samplingFrequency/2*sizeof(float));
+	pFLKDI->welch_n = 0;
+	if ((pFLKDI->welch_power == NULL) || update_window()) {
+		free_fft_resources();
 		return -1;
 	}
 
-	pFLKDI->fft_in = (float complex *)malloc(pFLKDI->samplingFrequency*sizeof(float complex));
+#ifdef FFT_FIXED_POINT
+	// fixed point fft runs in place in flk_data : only the Q15 twiddles are needed
+	if (fft_q15_prepare(pFLKDI->samplingFrequency)) {
+		free_fft_resources();
+		return -1;
+	}
+#else
+	pFLKDI->fft_in = (float complex *)malloc(FFT_BUFFER_NB(pFLKDI->samplingFrequency)*sizeof(float complex));
 	if (pFLKDI->fft_in == NULL) {
-		free(pFLKDI->flk_data);
+		free_fft_resources();
 		return -1;
 	}
-	pFLKDI->fft_out = (float complex *)malloc(pFLKDI->samplingFrequency*sizeof(float complex));
+	pFLKDI->fft_out = (float complex *)malloc(FFT_BUFFER_NB(pFLKDI->samplingFrequency)*sizeof(float complex));
 	if (pFLKDI->fft_out == NULL) {
-		free(pFLKDI->fft_in);
-		free(pFLKDI->flk_data);
+		free_fft_resources();
 		return -1;
 	}
 
+	// build (or fetch from cache) the fft tables for this size
+	// so that no table is computed on the flicker detect path
+	// (the real input fft also runs the half size complex transform)
+	if ((fft_plan_create(pFLKDI->samplingFrequency) == NULL) ||
+		(fft_plan_create(pFLKDI->samplingFrequency/2) == NULL)) {
+		free_fft_resources();
+		return -1;
+	}
+#endif
+
 	return 0;
 }
 
+
 //
-// free_fft_resources
-// disallocation of resources needed for fft to be performed
+// get_band_bins
+// converts the band of interest into the first and last bins to compute and search
+// bins are fe/nb Hz wide. The whole spectrum (bins 1 to nb/2-1) is used if no
+// band is set or if the band does not contain any bin
 //
-static void free_fft_resources() {
+static void get_band_bins(int fe, int nb, int * bin_first, int * bin_last)
+{
+	int first = (int)ceilf(pFLKDI->config.bandMin * nb / fe);
+	int last = (int)floorf(pFLKDI->config.bandMax * nb / fe);
 
-	free(pFLKDI->flk_data);
-	free(pFLKDI->fft_in);
-	free(pFLKDI->fft_out);
+	if (first < 1)
+		first = 1;
+	if (last > nb / 2 - 1)
+		last = nb / 2 - 1;
+
+	if ((pFLKDI->config.bandMax == 0) || (first > last)) {
+		first = 1;
+		last = nb / 2 - 1;
+	}
+
+	*bin_first = first;
+	*bin_last = last;
+}
+
+//
+// get_welch_segments
+// number of spectra averaged in welch mode : integration time over the result period
+//
+static int get_welch_segments()
+{
+	int integration = pFLKDI->config.integrationTime ? pFLKDI->config.integrationTime : FLK_WELCH_INTEGRATION_TIME_DEFAULT;
+	int period = pFLKDI->config.hopTime ? pFLKDI->config.hopTime : 1000;
+
+	return (integration >= period) ? integration / period : 1;
 }
 
+//
+// fft_detection
+// fft of the samples and search of the highest peaks in the band of interest
+// samples are taken through the configured window, spread over the valid samples
+// in welch mode, the peaks are searched in the power spectra of the 1 second
+// windows averaged over the integration time.
+// windows overlap in hop mode. the zero padded windows of the ramp restart the average
+//
+static void fft_detection(uint16_t samples_nb, uint16_t valid_samples_nb)
+{
+	int bin_first, bin_last;
+	int is_welch = (pFLKDI->config.mode == FLK_DETECT_MODE_WELCH) && (valid_samples_nb == samples_nb);
+	const float * window = pFLKDI->window;
+	// the platform does not remove DC from the samples
+	uint16_t dc = pFLKDI->fftResults.avgRawFlickerData;
+#ifdef FFT_FIXED_POINT
+	int fft_exponent;
+	int i, ws = samples_nb / valid_samples_nb;
+#endif
+
+	get_band_bins(pFLKDI->samplingFrequency, samples_nb, &bin_first, &bin_last);
+
+	if (!is_welch)
+		pFLKDI->welch_n = 0;
+	else if (pFLKDI->welch_n < get_welch_segments())
+		pFLKDI->welch_n++;
+
+	//LOG("Flicker channel : Start FFT on processed data\n");
+#ifdef FFT_FIXED_POINT
+	// DC removal in place, the fft runs on the Q15 samples
+	// the coefficients divided by the coherent gain may be over 1 : the samples are
+	// windowed with the actual coefficients and the amplitudes corrected afterwards
+	if (window)
+		for (i = 0; i < valid_samples_nb; i++)
+			pFLKDI->flk_data[i] = (int16_t)lrintf((pFLKDI->flk_data[i] - dc) * window[i*ws] * pFLKDI->window_gain);
+	else
+		for (i = 0; i < valid_samples_nb; i++)
+			pFLKDI->flk_data[i] -= dc;
+	// zero padding trick of the 0.25 or 0.5 second captures
+	memset(&pFLKDI->flk_data[valid_samples_nb], 0, (samples_nb - valid_samples_nb)*sizeof(int16_t));
+
+	fft_q15_real(pFLKDI->flk_data, samples_nb, &fft_exponent);
+	//LOG("Flicker channel : FFT completed\n");
+
+	if (is_welch) {
+		welch_accumulate_q15(pFLKDI->welch_power, pFLKDI->flk_data, fft_exponent, bin_first, bin_last, pFLKDI->welch_n,
+			1 / (pFLKDI->window_gain * pFLKDI->window_gain));
+		find_flk_freq_welch(pFLKDI->samplingFrequency,
+			pFLKDI->welch_power,
+			samples_nb,
+			bin_first,
+			bin_last,
+			FLK_PEAKS_NB,
+			&pFLKDI->fftResults.firstMaximaPeakFrequency,
+			&pFLKDI->fftResults.firstMaximaPeakAmplitude,
+			&pFLKDI->fftResults.secondMaximaPeakFrequency,
+			&pFLKDI->fftResults.secondMaximaPeakAmplitude,
+			&pFLKDI->fftResults.avgFlickerFreqAmplitude);
+	}
+	else {
+		find_flk_freq_q15(pFLKDI->samplingFrequency,
+			pFLKDI->flk_data,
+			fft_exponent,
+			samples_nb,
+			valid_samples_nb,
+			window != NULL,
+			bin_first,
+			bin_last,
+			FLK_PEAKS_NB,
+			&pFLKDI->fftResults.firstMaximaPeakFrequency,
+			&pFLKDI->fftResults.firstMaximaPeakAmplitude,
+			&pFLKDI->fftResults.secondMaximaPeakFrequency,
+			&pFLKDI->fftResults.secondMaximaPeakAmplitude,
+			&pFLKDI->fftResults.avgFlickerFreqAmplitude);
+		pFLKDI->fftResults.firstMaximaPeakAmplitude /= pFLKDI->window_gain;
+		pFLKDI->fftResults.secondMaximaPeakAmplitude /= pFLKDI->window_gain;
+		pFLKDI->fftResults.avgFlickerFreqAmplitude /= pFLKDI->window_gain;
+	}
+#else
+	perform_fft(pFLKDI->flk_data, pFLKDI->fft_in, pFLKDI->fft_out, samples_nb, valid_samples_nb, dc, window, bin_first, bin_last);
+	//LOG("Flicker channel : FFT completed\n");
+
+	if (is_welch) {
+		welch_accumulate(pFLKDI->welch_power, pFLKDI->fft_out, bin_first, bin_last, pFLKDI->welch_n, 1);
+		find_flk_freq_welch(pFLKDI->samplingFrequency,
+			pFLKDI->welch_power,
+			samples_nb,
+			bin_first,
+			bin_last,
+			FLK_PEAKS_NB,
+			&pFLKDI->fftResults.firstMaximaPeakFrequency,
+			&pFLKDI->fftResults.firstMaximaPeakAmplitude,
+			&pFLKDI->fftResults.secondMaximaPeakFrequency,
+			&pFLKDI->fftResults.secondMaximaPeakAmplitude,
+			&pFLKDI->fftResults.avgFlickerFreqAmplitude);
+	}
+	else
+		find_flk_freq_2(pFLKDI->samplingFrequency,
+			pFLKDI->fft_out,
+			samples_nb,
+			valid_samples_nb,
+			window != NULL,
+			bin_first,
+			bin_last,
+			FLK_PEAKS_NB,
+			&pFLKDI->fftResults.firstMaximaPeakFrequency,
+			&pFLKDI->fftResults.firstMaximaPeakAmplitude,
+			&pFLKDI->fftResults.secondMaximaPeakFrequency,
+			&pFLKDI->fftResults.secondMaximaPeakAmplitude,
+			&pFLKDI->fftResults.avgFlickerFreqAmplitude);
+#endif
+}
+
+//
+// goertzel_detection
+// evaluation of the configured frequencies only, directly on the samples
+//
+static void goertzel_detection(uint16_t samples_nb, uint16_t valid_samples_nb)
+{
+	// mains flicker (twice the 50 and 60 Hz mains frequencies) and second harmonics
+	// 4 frequencies fill one vector of filters (see find_flk_freq_goertzel)
+	static const float default_frequencies[] = {100, 120, 200, 240};
+	const float * frequencies = pFLKDI->config.goertzelFrequencies;
+	int frequencies_nb = pFLKDI->config.goertzelFrequenciesNb;
+
+	if (frequencies_nb == 0) {
+		frequencies = default_frequencies;
+		frequencies_nb = sizeof(default_frequencies)/sizeof(default_frequencies[0]);
+	}
+
+	find_flk_freq_goertzel(pFLKDI->samplingFrequency,
+		pFLKDI->flk_data,
+		pFLKDI->fftResults.avgRawFlickerData,
+		samples_nb,
+		valid_samples_nb,
+		frequencies,
+		frequencies_nb,
+		FLK_PEAKS_NB,
+		&pFLKDI->fftResults.firstMaximaPeakFrequency,
+		&pFLKDI->fftResults.firstMaximaPeakAmplitude,
+		&pFLKDI->fftResults.secondMaximaPeakFrequency,
+		&pFLKDI->fftResults.secondMaximaPeakAmplitude,
+		&pFLKDI->fftResults.avgFlickerFreqAmplitude);
+}
 
 //
 // flicker_detect_routine
@@ -100,8 +345,11 @@ static void free_fft_resources() {
 static void *flicker_detect_routine(void * dummy)
 {
 	int err;
-	uint16_t default_spi_frequency, actual_spi_frequency;
-	uint16_t samples_nb;
+	uint32_t default_spi_frequency, actual_spi_frequency;
+	uint16_t samples_nb, valid_samples_nb;
+	struct vd628x_flk_detect_config newConfig;
+	int newSamplingFrequency;
+	uint8_t newConfigAvailable;
 
 	UNUSED(dummy);
 
@@ -109,6 +357,9 @@ static void *flicker_detect_routine(void * dummy)
 	if (pFLKDI == NULL)
 		return NULL;
 
+	if (pFLKDI->config.computeCpu != FLK_CPU_ANY)
+		platform_set_thread_cpu(pFLKDI->config.computeCpu);
+
 	// launch auto gain search
 
 	//err = STALS_LIB_flk_autogain(pFLKDI->handle, pFLKDI->primaryChannelId, 35, &pFLKDI->fftResults.flickerChannelGain);
@@ -126,16 +377,16 @@ static void *flicker_detect_routine(void * dummy)
 	//	return NULL;
 	//}
 
-	while (pFLKDI->flicker_detect_runs) {
+	while (atomic_load(&pFLKDI->flicker_detect_runs)) {
 
 		// platform_get_samples returns
 		// -1 in case of error
-		// 0 is spi buffer transfer on going
-		// 1 if transfer completed
-		err = platform_chunck_transfer_and_get_samples(pFLKDI->client, pFLKDI->flk_data);
+		// 0 if the wait was cancelled by vd628x_flickerDetectStop
+		// 1 if a window is available in pFLKDI->flk_data
+		err = platform_get_samples(pFLKDI->client, &pFLKDI->flk_data);
 		if (err < 0 ) {
 			LOG("FATAL error : spi_grab failed !\n");
-			goto stop_and_exit;
+			goto error;
 		}
 		else if (err == 1) {
 
@@ -147,13 +398,16 @@ static void *flicker_detect_routine(void * dummy)
 				&pFLKDI->fftResults.maxRawFlickerData,
 				&pFLKDI->fftResults.minRawFlickerData,
 				&samples_nb,
+				&valid_samples_nb,
 				&actual_spi_frequency,
 				&default_spi_frequency
 				);
+			if (!err)
+				err = platform_get_samples_timestamp(pFLKDI->client, pFLKDI->flk_data, &pFLKDI->fftResults.timestamp);
 
 			if (err) {
 				LOG("FATAL error : spi_grab failed !\n");
-				goto stop_and_exit;
+				goto error;
 			}
 			else {
 				// stop flicker
@@ -163,18 +417,10 @@ static void *flicker_detect_routine(void * dummy)
 				//	return NULL;
 				//}
 
-				//LOG("Flicker channel : Start FFT on processed data\n");
-				perform_fft(pFLKDI->flk_data, pFLKDI->fft_in, pFLKDI->fft_out, samples_nb, 0);
-				//LOG("Flicker channel : FFT completed\n");
-
-				find_flk_freq_2(pFLKDI->samplingFrequency,
-					pFLKDI->fft_out,
-					samples_nb,
-					&pFLKDI->fftResults.firstMaximaPeakFrequency,
-					&pFLKDI->fftResults.firstMaximaPeakAmplitude,
-					&pFLKDI->fftResults.secondMaximaPeakFrequency,
-					&pFLKDI->fftResults.secondMaximaPeakAmplitude,
-					&pFLKDI->fftResults.avgFlickerFreqAmplitude);
+				if (pFLKDI->config.mode == FLK_DETECT_MODE_GOERTZEL)
+					goertzel_detection(samples_nb, valid_samples_nb);
+				else
+					fft_detection(samples_nb, valid_samples_nb);
 
 				//LOG("Flicker channel : found frequency peaks\n");
 				pFLKDI->fftResults.firstMaximaPeakFrequency *= ((float)actual_spi_frequency/default_spi_frequency);
@@ -182,16 +428,49 @@ static void *flicker_detect_routine(void * dummy)
 				pFLKDI->fftResults.configuredSamplingFlickerFreq = pFLKDI->samplingFrequency;
 				pFLKDI->send_fftResults((void *)(&pFLKDI->fftResults));
 
+				// take the settings provided meanwhile, if any
+				pthread_mutex_lock(&pFLKDI->config_mutex);
+				newSamplingFrequency = pFLKDI->newSamplingFrequency;
+				newConfigAvailable = pFLKDI->newConfigAvailable;
+				if (newConfigAvailable)
+					newConfig = pFLKDI->newConfig;
+				pFLKDI->newConfigAvailable = 0;
+				pthread_mutex_unlock(&pFLKDI->config_mutex);
+
 				// check if new samling frequency has been dynmically provided
-				if ((pFLKDI->newSamplingFrequency != 0) && (pFLKDI->newSamplingFrequency != pFLKDI->samplingFrequency)) {
-					free_fft_resources();
-					pFLKDI->samplingFrequency = pFLKDI->newSamplingFrequency;
-					err = allocate_fft_resources();
+				// the capture goes on at the current one if the platform can not switch
+				if ((newSamplingFrequency != 0) && (newSamplingFrequency != pFLKDI->samplingFrequency)) {
+					err = platform_set_fft_info(pFLKDI->client, newSamplingFrequency);
 					if (err) {
-						LOG("New Sampling frequency : Error. Can not allocate resources\n");
-						return NULL;
+						LOG("New Sampling frequency : Error. %d Hz kept\n", pFLKDI->samplingFrequency);
+						pthread_mutex_lock(&pFLKDI->config_mutex);
+						if (pFLKDI->newSamplingFrequency == newSamplingFrequency)
+							pFLKDI->newSamplingFrequency = 0;
+						pthread_mutex_unlock(&pFLKDI->config_mutex);
+					}
+					else {
+						free_fft_resources();
+						pFLKDI->samplingFrequency = newSamplingFrequency;
+						err = allocate_fft_resources();
+						if (err) {
+							LOG("New Sampling frequency : Error. Can not allocate resources\n");
+							goto error;
+						}
 					}
-					platform_set_fft_info(pFLKDI->client, pFLKDI->samplingFrequency);
+				}
+
+				// check if new detection settings have been dynamically provided
+				if (newConfigAvailable) {
+					int is_new_window = (newConfig.window != pFLKDI->config.window) ||
+						(newConfig.mode != pFLKDI->config.mode);
+
+					if (newConfig.hopTime != pFLKDI->config.hopTime)
+						platform_set_hop(pFLKDI->client, newConfig.hopTime);
+					pFLKDI->config = newConfig;
+					if (is_new_window && update_window())
+						LOG("New window : Error. Can not allocate resources. Rectangular window used\n");
+					// band, period or integration time may have changed
+					pFLKDI->welch_n = 0;
 				}
 
 				// launch auto gain search
@@ -216,6 +495,11 @@ static void *flicker_detect_routine(void * dummy)
 		}
 	}
 
+	goto stop_and_exit;
+
+error:
+	atomic_store(&pFLKDI->flicker_detect_error, 1);
+
 stop_and_exit:
 	// stop flicker
 	//err = STALS_Stop(pFLKDI->handle, STALS_MODE_FLICKER);
@@ -234,9 +518,10 @@ stop_and_exit:
 // allocation of resources necessary to run FFT on clear channel raw data
 // and starts internal thread responsible for capturing data from spi and performing FFT
 //
-int vd628x_flickerDetectStart(void * client, /*void * handle, enum STALS_Channel_Id_t primaryChannelId,*/ uint32_t samplingFrequency, int (* send_fftResults)(void * fftResults)) {
+int vd628x_flickerDetectStart(void * client, /*void * handle, enum STALS_Channel_Id_t primaryChannelId,*/ uint32_t samplingFrequency, const struct vd628x_flk_detect_config * config, int (* send_fftResults)(void * fftResults)) {
 
 	int err;
+	const char * fft_kernel_name;
 
 	if (pFLKDI != NULL) {
 		LOG("pFLKDI != NULL. flicker thread already started ?\n");
@@ -256,40 +541,67 @@ int vd628x_flickerDetectStart(void * client, /*void * handle, enum STALS_Channel
 
 	// init structure
 	memset(pFLKDI, 0, sizeof(struct vd628x_flk_detect_info));
+	pthread_mutex_init(&pFLKDI->config_mutex, NULL);
 
 	// store info from client locally
 	pFLKDI->client = client;
 	//pFLKDI->handle = handle;
 	//pFLKDI->primaryChannelId = primaryChannelId;
 	pFLKDI->samplingFrequency = samplingFrequency;
+	if (config != NULL)
+		pFLKDI->config = *config;
+	else {
+		pFLKDI->config.captureCpu = FLK_CPU_ANY;
+		pFLKDI->config.computeCpu = FLK_CPU_ANY;
+	}
+
+	// probe cpu features once and report the fft kernel that will be used
+	fft_simd_select(&fft_kernel_name);
+	LOG("fft stage kernel : %s\n", fft_kernel_name);
 
 	// allocated resources needed for fft to run
 	err = allocate_fft_resources();
 	if (err) {
+		pthread_mutex_destroy(&pFLKDI->config_mutex);
 		free(pFLKDI);
+		pFLKDI = NULL;
 		return -1;
 	}
 
 	// platform_spi_start opens /dev/vd628x_spi and starts a thread that capture spi data
-	err = platform_spi_start(pFLKDI->client, samplingFrequency);
+	err = platform_spi_start(pFLKDI->client, samplingFrequency, pFLKDI->config.captureCpu);
 	if (err != 0) {
 		LOG("ERROR : Error in starting spi capture\n");
+		pthread_mutex_destroy(&pFLKDI->config_mutex);
 		free_fft_resources();
 		free(pFLKDI);
+		pFLKDI = NULL;
 		return -1;
 	}
 	LOG("capture from spi started.\n");
 
+	// overlapping 1 second windows published every hop
+	if (pFLKDI->config.hopTime)
+		platform_set_hop(pFLKDI->client, pFLKDI->config.hopTime);
+
+	// recording of the captured chunks
+	if (pFLKDI->config.record)
+		platform_set_record(pFLKDI->client, pFLKDI->config.record);
+
 	// start a thread that gets the ALS values and the spi buffers to run FFT on
 	// flicker detect thread
-	pFLKDI->flicker_detect_runs = 1;
+	atomic_store(&pFLKDI->flicker_detect_runs, 1);
 	pFLKDI->send_fftResults = send_fftResults;
 	err = pthread_create(&pFLKDI->flicker_detect_thread, NULL, flicker_detect_routine, NULL);
 	if (err) {
 		LOG("flicker thread create failed\n");
-		pFLKDI->flicker_detect_runs = 0;
+		atomic_store(&pFLKDI->flicker_detect_runs, 0);
+		// the capture and the recording started above are stopped first
+		platform_spi_stop(pFLKDI->client);
+		pthread_mutex_destroy(&pFLKDI->config_mutex);
 		free_fft_resources();
 		free(pFLKDI);
+		pFLKDI = NULL;
 		return -1;
 	}
 	LOG("flicker thread created.\n");
@@ -311,11 +623,47 @@ int vd628x_flickerDetectNewSamplingFrequency(uint16_t samplingFrequency) {
 		return -1;
 	}
 
+	pthread_mutex_lock(&pFLKDI->config_mutex);
 	pFLKDI->newSamplingFrequency = samplingFrequency;
+	pthread_mutex_unlock(&pFLKDI->config_mutex);
+
+	return 0;
+}
+
+//
+// vd628x_flickerDetectNewConfig
+// Function aimed to support dynamic update of the detection settings from application
+// the new settings are applied from the next fft on
+//
+int vd628x_flickerDetectNewConfig(const struct vd628x_flk_detect_config * config) {
+	if ((pFLKDI == NULL) || (config == NULL)) {
+		LOG("FATAL error pFLKDI == NULL\n");
+		return -1;
+	}
+
+	pthread_mutex_lock(&pFLKDI->config_mutex);
+	pFLKDI->newConfig = *config;
+	pFLKDI->newConfigAvailable = 1;
+	pthread_mutex_unlock(&pFLKDI->config_mutex);
+
+	// the recording is started and stopped from here, not by the flicker detect thread
+	platform_set_record(pFLKDI->client, config->record);
 
 	return 0;
 }
 
+//
+// vd628x_flickerDetectFailed
+// returns 1 if the flicker detect thread stopped on error : no more results will come
+// until vd628x_flickerDetectStop and vd628x_flickerDetectStart are called
+//
+int vd628x_flickerDetectFailed() {
+	if (pFLKDI == NULL)
+		return 0;
+
+	return atomic_load(&pFLKDI->flicker_detect_error);
+}
+
 //
 // vd628x_flickerDetectStop
 // Stop of grab of raw data from SPI, stop and deletion internal thread.
@@ -323,9 +671,9 @@ int vd628x_flickerDetectNewSamplingFrequency(uint16_t samplingFrequency) {
 int vd628x_flickerDetectStop() {
 	void *retval;
 
-	// ensure the ending of the thread
-	// to be added : mutex to protect flicker_detect_runs
-	pFLKDI->flicker_detect_runs = 0;
+	// ensure the ending of the thread, woken up if it waits for a window
+	atomic_store(&pFLKDI->flicker_detect_runs, 0);
+	platform_cancel_get_samples(pFLKDI->client);
 
 	// wait for the thread completion
 	pthread_join(pFLKDI->flicker_detect_thread, &retval);
@@ -334,7 +682,10 @@ int vd628x_flickerDetectStop() {
 	platform_spi_stop(pFLKDI->client);
 
 	// free resources
+	pthread_mutex_destroy(&pFLKDI->config_mutex);
 	free_fft_resources();
+	fft_plan_cleanup();
+	fft_q15_cleanup();
 	free(pFLKDI);
 	pFLKDI = NULL;
 
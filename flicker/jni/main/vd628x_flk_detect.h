@@ -20,10 +20,60 @@ struct vd628x_flk_detect_fftResults {
 	uint16_t minRawFlickerData;
 	uint16_t flickerChannelGain;
 	uint16_t configuredSamplingFlickerFreq;
+	// CLOCK_MONOTONIC time in ns of the centre of the analysed window
+	uint64_t timestamp;
 };
 
-int vd628x_flickerDetectStart(void * client, /*void * handle, enum STALS_Channel_Id_t primaryChannelId, */uint32_t samplingFrequency, int (* send_fftResults)(void * fftResults));
+// detection modes
+#define FLK_DETECT_MODE_FFT 0      // fft and peak search over the band of interest
+#define FLK_DETECT_MODE_GOERTZEL 1 // Goertzel filters on a list of known frequencies
+#define FLK_DETECT_MODE_WELCH 2    // peak search on the power spectrum averaged over the integration time
+
+#define FLK_GOERTZEL_FREQUENCIES_MAX 16
+
+// window functions of the fft modes (same values as FFT_WINDOW_xxx of vd628x_fft_utils.h)
+#define FLK_WINDOW_RECTANGULAR 0
+#define FLK_WINDOW_HANN 1
+#define FLK_WINDOW_BLACKMAN_HARRIS 2
+#define FLK_WINDOW_FLAT_TOP 3
+
+//
+// vd628x_flk_detect_config
+// detection settings that the client can change while flicker detection runs
+//
+struct vd628x_flk_detect_config {
+	// band of interest in Hz. 0 to 0 is the whole spectrum
+	float bandMin;
+	float bandMax;
+	// FLK_DETECT_MODE_FFT, FLK_DETECT_MODE_GOERTZEL or FLK_DETECT_MODE_WELCH
+	uint8_t mode;
+	// frequencies in Hz evaluated in FLK_DETECT_MODE_GOERTZEL
+	// if empty, mains flicker frequencies and their first harmonics are used
+	uint8_t goertzelFrequenciesNb;
+	float goertzelFrequencies[FLK_GOERTZEL_FREQUENCIES_MAX];
+	// period in ms of the results once the 1 second capture is reached
+	// 0 : one result per second of capture, no overlap
+	uint16_t hopTime;
+	// time in ms over which power spectra are averaged in FLK_DETECT_MODE_WELCH
+	// 0 : FLK_WELCH_INTEGRATION_TIME_DEFAULT
+	uint16_t integrationTime;
+	// FLK_WINDOW_xxx window function of the fft modes
+	uint8_t window;
+	// cpus of the capture and flicker detect threads, FLK_CPU_ANY for no affinity
+	// applied by vd628x_flickerDetectStart only
+	int8_t captureCpu;
+	int8_t computeCpu;
+	// 1 : captured chunks are recorded by the platform
+	uint8_t record;
+};
+
+#define FLK_WELCH_INTEGRATION_TIME_DEFAULT 4000
+#define FLK_CPU_ANY -1
+
+int vd628x_flickerDetectStart(void * client, /*void * handle, enum STALS_Channel_Id_t primaryChannelId, */uint32_t samplingFrequency, const struct vd628x_flk_detect_config * config, int (* send_fftResults)(void * fftResults));
 int vd628x_flickerDetectNewSamplingFrequency(uint16_t samplingFrequency);
+int vd628x_flickerDetectNewConfig(const struct vd628x_flk_detect_config * config);
+int vd628x_flickerDetectFailed();
 int vd628x_flickerDetectStop();
 
 #ifdef __cplusplus
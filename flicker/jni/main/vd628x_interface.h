@@ -54,6 +54,16 @@ struct SensorAttribute
 };
 
 
+// @brief Queue of the flicker channel captures between the capture and the FFT threads
+struct CaptureStatisticsInfo
+{
+    uint16_t          queueSize;          ///< Number of captures the queue can hold
+    uint16_t          queueDepth;         ///< Number of captures in the queue now
+    uint16_t          queueHighWaterMark; ///< Maximum number of captures in the queue since start
+    uint32_t          overruns;           ///< Number of captures dropped because the queue was full
+    uint32_t          stalls;             ///< Number of spi bus stalls, the capture restarted after each
+};
+
 // @breif Driver Info
 struct DriverInformation
 {
@@ -107,7 +117,7 @@ struct SpectralFlickerFrequencyInfo
 // @brief Main Data Structure that contains Spectral Sensor Data
 struct NCSDataMultiSpectralSensor
 {
-    uint64_t                        timestamp;      ///< Time Stamp of the data
+    uint64_t                        timestamp;      ///< Time Stamp of the centre of the analysed window : QTimer time, CLOCK_MONOTONIC ns until QTimeStamp is configured
     SpectralFlickerFrequencyInfo  flickerInfo;    ///< Flicker Information
 };
 
@@ -120,6 +130,8 @@ enum QueryPayloadType
                         ///  Payload: DriverInformation
     SensorAttributes,   ///< List of sensor attributes
                         ///  Payload: SensorAttribute
+    CaptureStatistics,  ///< State of the queue of flicker channel captures waiting for the FFT. Zeros if not started
+                        ///  Payload: CaptureStatisticsInfo
     MaxPayloadTypeCount ///<  Maximum
 };
 
@@ -132,11 +144,55 @@ enum ConfigurationType
     SamplingTime,      ///< Configure Sampling time of CCT and Lux on non-flicker channels in micro sec
                        ///  Payload: UINT32
     QTimeStamp,        ///< Sets the QTimer timestamp to the driver to synchronize clocks and reduce clock drift.
-                       ///  Camera runs w.r.t Qtimer. will call it after regular intervals.
+                       ///  Camera runs w.r.t Qtimer. will call it after regular intervals. Can be called while started.
+                       ///  Once called, data timestamps are QTimer times, from offset and drift fitted on the last 16 calls.
                        ///  Payload: uint64_t_t Qtimer timestamp
+    FrequencyBand,     ///< Restricts the flicker frequency computation and peak search to a band of interest in Hertz.
+                       ///  Can be changed while started. min = max = 0 restores the whole spectrum.
+                       ///  Payload: RangeFloat
+    DetectionMode,     ///< Selects how the flicker frequency is detected. Can be changed while started.
+                       ///  Payload: UINT32 FlickerDetectionMode
+    GoertzelFrequency, ///< Adds a frequency in Hertz to the list evaluated in GoertzelDetection mode (16 max).
+                       ///  A frequency of 0 clears the list. Empty list means 100, 120, 200 and 240 Hz.
+                       ///  Payload: float
+    HopTime,           ///< Period in ms of the flicker results once 1 second of data is captured (1000 max). Results are
+                       ///  computed on the last second of data, windows overlap. Can be changed while started.
+                       ///  0 (default) gives one result per second of data, without overlap.
+                       ///  Payload: UINT32
+    IntegrationTime,   ///< Time in ms over which power spectra are averaged in WelchDetection mode (60000 max).
+                       ///  0 (default) means 4000 ms. Can be changed while started.
+                       ///  Payload: UINT32
+    WindowFunction,    ///< Selects the window function applied to the flicker channel samples before the FFT.
+                       ///  Amplitudes are corrected by the coherent gain of the window. Can be changed while started.
+                       ///  Payload: UINT32 FlickerWindowFunction
+    CaptureCpu,        ///< Binds the thread capturing the flicker channel to a CPU. -1 (default) for no affinity.
+                       ///  Payload: INT32
+    ComputeCpu,        ///< Binds the thread running the FFT to a CPU. -1 (default) for no affinity.
+                       ///  Payload: INT32
+    RecordSamples,     ///< 1 records the flicker channel samples, their timestamps and the sampling and spi
+                       ///  frequencies in a new file of PLATFORM_RECORD_DIR, 0 (default) stops the recording.
+                       ///  Can be changed while started.
+                       ///  Payload: UINT32
     MaxConfigType      ///<  Maximum
 };
 
+// @brief Flicker detection modes
+enum FlickerDetectionMode
+{
+    FftDetection,      ///< FFT of the flicker channel and peak search (default)
+    GoertzelDetection, ///< Goertzel filters evaluating a list of known frequencies only
+    WelchDetection     ///< Peak search on the power spectra of Hann windowed captures averaged over IntegrationTime
+};
+
+// @brief Window functions applied before the FFT
+enum FlickerWindowFunction
+{
+    RectangularWindow,    ///< No window (default). Hann window in WelchDetection mode
+    HannWindow,           ///< Hann window
+    BlackmanHarrisWindow, ///< 4 terms Blackman-Harris window, lowest leakage
+    FlatTopWindow         ///< Flat-top window, most accurate amplitudes
+};
+
 // @brief QueryInfo structure to query into any Sensor Driver supporting this Spectral Sensor Interface
 struct QueryInfo
 {
@@ -155,6 +211,14 @@ struct ConfigureParameters
         uint32_t            samplingTime;       ///< Sampling Time of the spectral sensor for CCT/LUX
         uint32_t            samplingFrequency;  ///< Sampling Frequency of the flicker channel
         uint64_t            timestamp;          ///< Qtimer Time Stamp
+        RangeFloat          frequencyBand;      ///< Band of interest of the flicker frequency in Hz
+        uint32_t            detectionMode;      ///< FlickerDetectionMode
+        float               goertzelFrequency;  ///< Frequency in Hz evaluated in GoertzelDetection mode
+        uint32_t            hopTime;            ///< Period of the flicker results in ms
+        uint32_t            integrationTime;    ///< Averaging time of WelchDetection mode in ms
+        uint32_t            windowFunction;     ///< FlickerWindowFunction
+        int32_t             cpu;                ///< CPU index of CaptureCpu and ComputeCpu, -1 for no affinity
+        uint32_t            recordSamples;      ///< 1 to record the flicker channel samples, 0 to stop
     } configPayload;
 };
 
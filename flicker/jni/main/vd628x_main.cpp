@@ -11,11 +11,13 @@ This file is licensed under open source license ST SLA0103
 #include <inttypes.h>
 #include <complex.h>
 #include <pthread.h>
+#include <time.h>
 
 #include "vd628x_interface.h"
 
 #include "vd628x_platform.h"
 #include "vd628x_flk_detect.h"
+#include "vd628x_clock_sync.h"
 
 #define UNUSED(p)  ((void)(p))
 
@@ -81,10 +83,14 @@ struct vd628x_Info {
 	uint8_t state;
 	// info about channels
 	uint32_t samplingFrequency;
+	// detection settings passed to flicker detection
+	struct vd628x_flk_detect_config flkDetectConfig;
 	// Main Data Structure that contains Spectral Sensor Data
 	int8_t dataMultiSpectralSensorAlsInfoIndex;
 	int8_t dataMultiSpectralSensorFlickerInfoIndex;
 	struct NCSDataMultiSpectralSensor dataMultiSpectralSensor[MAX_DATA_MULTI_SPECTRAL_SENSOR];
+	// QTimer model fed by QTimeStamp. protected by mutexFlicker
+	struct vd628x_clock_sync qtimerSync;
 	// thread to make start and stop blocking
 	uint8_t mainThreadRuns;
 	uint8_t mainThreadStarted;
@@ -147,6 +153,12 @@ static struct SensorAttribute vd628x_sensorAttribute =
 };
 
 
+//
+// Capture statistics returned by QuerySensorInfo
+//
+static struct CaptureStatisticsInfo vd628x_captureStatistics;
+
+
 //
 // fftResults_callback
 // callback called at each new flicker frequency is calculated
@@ -168,6 +180,9 @@ static int fftResults_callback(void * fftResults)
 		pVCI->dataMultiSpectralSensorFlickerInfoIndex = 0;
 
 	//LOG("--------------- FLICKER DETECT : fft results call back called\n");
+	// QTimer time once QTimeStamp was configured
+	pVCI->dataMultiSpectralSensor[pVCI->dataMultiSpectralSensorFlickerInfoIndex].timestamp =
+		vd628x_clock_sync_convert(&pVCI->qtimerSync, pFFTR->timestamp);
 	pflickerInfo = &pVCI->dataMultiSpectralSensor[pVCI->dataMultiSpectralSensorFlickerInfoIndex].flickerInfo;
 	pflickerInfo->isValid = TRUE;
 	pflickerInfo->firstMaximaPeak.frequency = pFFTR->firstMaximaPeakFrequency;
@@ -204,7 +219,7 @@ static int Start() {
 
 	LOG("Starting FLICKER .... \n");
 	// start a thread that captures spi buffers to run FFT on
-	err = vd628x_flickerDetectStart(pVCI->client, pVCI->samplingFrequency, fftResults_callback);
+	err = vd628x_flickerDetectStart(pVCI->client, pVCI->samplingFrequency, &pVCI->flkDetectConfig, fftResults_callback);
 	if (err) {
 		LOG("Start failed. vd628x_flickerDetectStart failed\n");
 		return -1;
@@ -320,6 +335,23 @@ static void QuerySensorInfo(QueryInfo* pQuery) {
 		pQuery->pData = (void *)&vd628x_sensorAttribute;
 		pQuery->size = sizeof(vd628x_attributes);
 	}
+	else if (pQuery->queryType == CaptureStatistics) {
+		memset(&vd628x_captureStatistics, 0, sizeof(struct CaptureStatisticsInfo));
+		if (pVCI != NULL) {
+			// the capture runs between Start and Stop, both called with mutexApi locked
+			pthread_mutex_lock(&pVCI->mutexApi);
+			if (pVCI->state == STARTED)
+				platform_get_capture_stats(pVCI->client,
+					&vd628x_captureStatistics.queueSize,
+					&vd628x_captureStatistics.queueDepth,
+					&vd628x_captureStatistics.queueHighWaterMark,
+					&vd628x_captureStatistics.overruns,
+					&vd628x_captureStatistics.stalls);
+			pthread_mutex_unlock(&pVCI->mutexApi);
+		}
+		pQuery->pData = (void *)&vd628x_captureStatistics;
+		pQuery->size = sizeof(struct CaptureStatisticsInfo);
+	}
 }
 
 
@@ -331,7 +363,12 @@ static void QuerySensorInfo(QueryInfo* pQuery) {
 static int Configure(const ConfigureParameters* pConfig, const unsigned int numOfConfigParams) {
 
 	uint8_t i, j;
+	uint8_t isNewFlkDetectConfig = 0;
 	const ConfigureParameters* pC = pConfig;
+	struct timespec now;
+
+	// time of the QTimer timestamps, as early as possible
+	clock_gettime(CLOCK_MONOTONIC, &now);
 
 	// error if not opened
 	if (pVCI == NULL) {
@@ -349,7 +386,11 @@ static int Configure(const ConfigureParameters* pConfig, const unsigned int numO
 	pthread_mutex_lock(&pVCI->mutexApi);
 
 	// error if state is STARTED
-	if (pC->configType != SamplingFrequency) { // Client requests to have bew SamplingFrequency supported dynamically
+	if ((pC->configType != SamplingFrequency) && (pC->configType != FrequencyBand) &&
+		(pC->configType != DetectionMode) && (pC->configType != GoertzelFrequency) &&
+		(pC->configType != HopTime) && (pC->configType != IntegrationTime) &&
+		(pC->configType != WindowFunction) && (pC->configType != QTimeStamp) &&
+		(pC->configType != RecordSamples)) { // Client requests to have bew SamplingFrequency and detection settings supported dynamically
 		if (pVCI->state != STOPPED)  {
 			LOG("Configure sensor failed. Sensor already started\n");
 			goto fail;
@@ -374,6 +415,109 @@ static int Configure(const ConfigureParameters* pConfig, const unsigned int numO
 			LOG("SensorConfigure failed. Sampling frequency is out of supported range\n");
 			goto fail;
 		}
+		else if (pC->configType == FrequencyBand) {
+			if ((pC->configPayload.frequencyBand.min < 0) ||
+				(pC->configPayload.frequencyBand.max < pC->configPayload.frequencyBand.min) ||
+				(pC->configPayload.frequencyBand.max > sampling_frequencies[0]))
+			{
+				LOG("SensorConfigure failed. Frequency band is out of supported range\n");
+				goto fail;
+			}
+			pVCI->flkDetectConfig.bandMin = pC->configPayload.frequencyBand.min;
+			pVCI->flkDetectConfig.bandMax = pC->configPayload.frequencyBand.max;
+			LOG("SensorConfigure frequencyBand = %f to %f Hz\n", pVCI->flkDetectConfig.bandMin, pVCI->flkDetectConfig.bandMax);
+			isNewFlkDetectConfig = 1;
+		}
+		else if (pC->configType == DetectionMode) {
+			if (pC->configPayload.detectionMode == FftDetection)
+				pVCI->flkDetectConfig.mode = FLK_DETECT_MODE_FFT;
+			else if (pC->configPayload.detectionMode == GoertzelDetection)
+				pVCI->flkDetectConfig.mode = FLK_DETECT_MODE_GOERTZEL;
+			else if (pC->configPayload.detectionMode == WelchDetection)
+				pVCI->flkDetectConfig.mode = FLK_DETECT_MODE_WELCH;
+			else {
+				LOG("SensorConfigure failed. Unknown detection mode\n");
+				goto fail;
+			}
+			LOG("SensorConfigure detectionMode = %d\n", pC->configPayload.detectionMode);
+			isNewFlkDetectConfig = 1;
+		}
+		else if (pC->configType == GoertzelFrequency) {
+			if (pC->configPayload.goertzelFrequency == 0)
+				pVCI->flkDetectConfig.goertzelFrequenciesNb = 0;
+			else if ((pC->configPayload.goertzelFrequency < 0) ||
+				(2 * pC->configPayload.goertzelFrequency >= sampling_frequencies[0]) ||
+				(pVCI->flkDetectConfig.goertzelFrequenciesNb == FLK_GOERTZEL_FREQUENCIES_MAX))
+			{
+				LOG("SensorConfigure failed. Goertzel frequency out of range or too many frequencies\n");
+				goto fail;
+			}
+			else
+				pVCI->flkDetectConfig.goertzelFrequencies[pVCI->flkDetectConfig.goertzelFrequenciesNb++] = pC->configPayload.goertzelFrequency;
+			LOG("SensorConfigure goertzelFrequency = %f Hz (%d frequencies)\n", pC->configPayload.goertzelFrequency, pVCI->flkDetectConfig.goertzelFrequenciesNb);
+			isNewFlkDetectConfig = 1;
+		}
+		else if (pC->configType == HopTime) {
+			if (pC->configPayload.hopTime > 1000) {
+				LOG("SensorConfigure failed. Hop time is out of supported range\n");
+				goto fail;
+			}
+			pVCI->flkDetectConfig.hopTime = (uint16_t)pC->configPayload.hopTime;
+			LOG("SensorConfigure hopTime = %d ms\n", pVCI->flkDetectConfig.hopTime);
+			isNewFlkDetectConfig = 1;
+		}
+		else if (pC->configType == IntegrationTime) {
+			if (pC->configPayload.integrationTime > 60000) {
+				LOG("SensorConfigure failed. Integration time is out of supported range\n");
+				goto fail;
+			}
+			pVCI->flkDetectConfig.integrationTime = (uint16_t)pC->configPayload.integrationTime;
+			LOG("SensorConfigure integrationTime = %d ms\n", pVCI->flkDetectConfig.integrationTime);
+			isNewFlkDetectConfig = 1;
+		}
+		else if (pC->configType == WindowFunction) {
+			if (pC->configPayload.windowFunction == RectangularWindow)
+				pVCI->flkDetectConfig.window = FLK_WINDOW_RECTANGULAR;
+			else if (pC->configPayload.windowFunction == HannWindow)
+				pVCI->flkDetectConfig.window = FLK_WINDOW_HANN;
+			else if (pC->configPayload.windowFunction == BlackmanHarrisWindow)
+				pVCI->flkDetectConfig.window = FLK_WINDOW_BLACKMAN_HARRIS;
+			else if (pC->configPayload.windowFunction == FlatTopWindow)
+				pVCI->flkDetectConfig.window = FLK_WINDOW_FLAT_TOP;
+			else {
+				LOG("SensorConfigure failed. Unknown window function\n");
+				goto fail;
+			}
+			LOG("SensorConfigure windowFunction = %d\n", pC->configPayload.windowFunction);
+			isNewFlkDetectConfig = 1;
+		}
+		else if ((pC->configType == CaptureCpu) || (pC->configType == ComputeCpu)) {
+			if ((pC->configPayload.cpu < FLK_CPU_ANY) || (pC->configPayload.cpu > INT8_MAX) ||
+				(pC->configPayload.cpu >= sysconf(_SC_NPROCESSORS_CONF)))
+			{
+				LOG("SensorConfigure failed. CPU is out of range\n");
+				goto fail;
+			}
+			if (pC->configType == CaptureCpu)
+				pVCI->flkDetectConfig.captureCpu = (int8_t)pC->configPayload.cpu;
+			else
+				pVCI->flkDetectConfig.computeCpu = (int8_t)pC->configPayload.cpu;
+			LOG("SensorConfigure %s cpu = %d\n", (pC->configType == CaptureCpu) ? "capture" : "compute", pC->configPayload.cpu);
+		}
+		else if (pC->configType == RecordSamples) {
+			if (pC->configPayload.recordSamples > 1) {
+				LOG("SensorConfigure failed. Record samples is 0 or 1\n");
+				goto fail;
+			}
+			pVCI->flkDetectConfig.record = (uint8_t)pC->configPayload.recordSamples;
+			LOG("SensorConfigure recordSamples = %d\n", pVCI->flkDetectConfig.record);
+			isNewFlkDetectConfig = 1;
+		}
+		else if (pC->configType == QTimeStamp) {
+			pthread_mutex_lock(&pVCI->mutexFlicker);
+			vd628x_clock_sync_add(&pVCI->qtimerSync, (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec, pC->configPayload.timestamp);
+			pthread_mutex_unlock(&pVCI->mutexFlicker);
+		}
 		else {
 			LOG("SensorConfigure failed. Wrong input params\n");
 			goto fail;
@@ -383,6 +527,8 @@ static int Configure(const ConfigureParameters* pConfig, const unsigned int numO
 	}
 
 success:
+	if (isNewFlkDetectConfig && (pVCI->state == STARTED))
+		vd628x_flickerDetectNewConfig(&pVCI->flkDetectConfig);
 	LOG("Configure ALS Device OK\n");
 	pthread_mutex_unlock(&pVCI->mutexApi);
 	return 0;
@@ -411,14 +557,11 @@ static int OpenSensor() {
 	}
 
 	// look if /dev/vd628x_spi can be opened, if not sensor is not here
-	int dev_vd628x_spi;
-	dev_vd628x_spi = open("/dev/vd628x_spi", O_RDWR);
-	if (dev_vd628x_spi < 0) {
+	if (platform_probe_device(PLATFORM_SPI_DEVICE)) {
 		// sensor not here
-		LOG("OpenSensor failed. open /dev/vd628x_spi failed\n");
+		LOG("OpenSensor failed. open %s failed\n", PLATFORM_SPI_DEVICE);
 		return -2;
 	}
-	close(dev_vd628x_spi);
 
 	// allocate internal structure info
 	pVCI = new(struct vd628x_Info);
@@ -434,6 +577,9 @@ static int OpenSensor() {
 	pVCI->client = NULL;
 	pVCI->state = STOPPED;
 	pVCI->samplingFrequency = sampling_frequencies[DEFAULT_SAMPLING_FREQUENCY_INDEX];
+	pVCI->flkDetectConfig.captureCpu = FLK_CPU_ANY;
+	pVCI->flkDetectConfig.computeCpu = FLK_CPU_ANY;
+	vd628x_clock_sync_init(&pVCI->qtimerSync, CLOCK_SYNC_QTIMER_FREQUENCY);
 
 	// reset all data to be polled
 	pVCI->dataMultiSpectralSensorFlickerInfoIndex = -1; // -1 this means that the table is empty.
@@ -537,6 +683,13 @@ static int PollSensorData(const uint8_t numSamples, void * pSensorData) {
 	// wait for api mutex
 	pthread_mutex_lock(&pVCI->mutexApi);
 
+	// the flicker detection runs between Start and Stop, both called with mutexApi locked
+	if ((pVCI->state == STARTED) && vd628x_flickerDetectFailed()) {
+		LOG("PollSensorData failed. Flicker detection stopped on error\n");
+		pthread_mutex_unlock(&pVCI->mutexApi);
+		return -1;
+	}
+
 	pthread_mutex_lock(&pVCI->mutexFlicker);
 
 	// 2. flicker
@@ -548,6 +701,7 @@ static int PollSensorData(const uint8_t numSamples, void * pSensorData) {
 		pSD = (struct NCSDataMultiSpectralSensor *)pSensorData;
 		while (pVCI->dataMultiSpectralSensor[i].flickerInfo.isValid) {
 			memcpy(&pSD->flickerInfo, &pVCI->dataMultiSpectralSensor[i].flickerInfo, sizeof(struct SpectralFlickerFrequencyInfo));
+			pSD->timestamp = pVCI->dataMultiSpectralSensor[i].timestamp;
 			if (i == 0)
 				i = MAX_DATA_MULTI_SPECTRAL_SENSOR-1;
 			else
@@ -2,17 +2,30 @@
 Copyright (c) 2025, STMicroelectronics - All Rights Reserved
 This file is licensed under open source license ST SLA0103
 ********************************************************************************/
-#include <fcntl.h>
+// sched_setaffinity and CPU_SET
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <errno.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 #include <string.h>
+#include <math.h>
 #include <pthread.h>
-#include <sys/ioctl.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <poll.h>
+#include <limits.h>
+#include <sys/eventfd.h>
 
 #include "vd628x_platform.h"
 #include "vd628x_adapter_ioctl.h"
+#include "vd628x_ring.h"
+#include "vd628x_backend.h"
+#include "vd628x_recorder.h"
 
 #define LOG printf
 
@@ -21,7 +34,7 @@ This file is licensed under open source license ST SLA0103
 // DEFAULT_SPI_FREQUENCY is the default SPI frequency, assumming that actual spi frequency MUST NOT be > DEFAULT_SPI_FREQUENCY Khz
 // device tree of the vd6281 must provide spi_frequency value that must not be over this value
 // But actual sp frequency can be lowered and linux does not provide a way to get this value.
-// This driver therefore provides the LOCALLY_MEASURED_SPI_FREQUENCY option that calculates the SPI frequency
+// This driver therefore provides the LOCALLY_MEASURED_SPI_FREQUENCY option that estimates the SPI frequency from the chunk times
 // flicker frequencies are calculated for spi frequency = DEFAULT_SPI_FREQUENCY Khz, and is then just adjusted with the locally measured frequency
 #define DEFAULT_SPI_FREQUENCY           (4*1024*1024) // in Hz
 // spi buffer size for 1 second data.
@@ -29,7 +42,112 @@ This file is licensed under open source license ST SLA0103
 // actual buffer size (this is for 1 second, actually)
 #define SPI_BUFFER_SIZE	                (SPI_BUFFER_SIZE_1_SEC_DATA)
 
+// number of sample buffers of the capture ring : one is filled by the capture
+// thread, one is analysed by the flicker detect thread, the other ones are queued
+#ifndef PLATFORM_BUFFERS_NB
+#define PLATFORM_BUFFERS_NB 3
+#endif
+#if PLATFORM_BUFFERS_NB < 2
+#error "PLATFORM_BUFFERS_NB must be 2 at least"
+#endif
+
+// seconds of chunks in the ring mapped from the driver : one window is kept
+// for the hop mode while the driver writes the next chunks
+#define PLATFORM_RING_SECONDS 2
+
+// time without chunk after which the spi bus is reported as stalled
+#ifndef PLATFORM_STALL_TIMEOUT_MS
+#define PLATFORM_STALL_TIMEOUT_MS 1000
+#endif
+
+// relative standard error of the spi clock estimate under which it is stable
+// and no more chunk time is accounted for, once PLATFORM_SPI_CLOCK_MIN_SECONDS
+// of chunks are
+#ifndef PLATFORM_SPI_CLOCK_PPM
+#define PLATFORM_SPI_CLOCK_PPM 20
+#endif
+#define PLATFORM_SPI_CLOCK_MIN_SECONDS 4
+
+// the estimate replaces the nominal or previous spi frequency once it is fitted
+// over 1 second of chunks and its relative standard error is under this bound
+#define PLATFORM_SPI_CLOCK_PUBLISH_PPM 1000
+
+// once stable, the end time of the transfer that completes a window is checked
+// against the fit. the fit is reopened when PLATFORM_SPI_CLOCK_OUTLIERS windows
+// in a row are off by more than PLATFORM_SPI_CLOCK_SIGMAS times the standard
+// deviation of the fitted times, PLATFORM_SPI_CLOCK_RESIDUAL_MIN_NS at least
+#define PLATFORM_SPI_CLOCK_SIGMAS 8
+#define PLATFORM_SPI_CLOCK_RESIDUAL_MIN_NS 100000
+#define PLATFORM_SPI_CLOCK_OUTLIERS 3
+
+// results of wait_device
+#define WAIT_READY 1
+#define WAIT_CANCELLED 0
+#define WAIT_TIMEOUT -1
+#define WAIT_ERROR -2
+
+// slots of the buffer queues : every buffer can be queued, one slot stays empty
+#define PLATFORM_QUEUE_SLOTS (PLATFORM_BUFFERS_NB + 1)
+
+struct platform_buffer {
+	int16_t * samples;       // samples_number[2] samples
+	uint64_t * chunk_times;  // max_transfers[2] chunk end times, CLOCK_MONOTONIC ns
+	uint64_t timestamp;      // centre of the window, CLOCK_MONOTONIC ns
+	uint8_t index;           // window of the ramp : samples_number[index] valid samples
+	uint32_t sequence;       // order of the captured windows
+	uint32_t spi_frequency;  // spi frequency in Hz when the window was captured
+};
+
+//
+// platform_queue
+// wait-free single producer single consumer queue of buffers
+// tail is written by the producer only, head by the consumer only
+//
+struct platform_queue {
+	struct platform_buffer * slots[PLATFORM_QUEUE_SLOTS];
+	atomic_uint head;  // next slot read by the consumer
+	atomic_uint tail;  // next slot written by the producer
+};
+
+//
+// spi_clock
+// spi clock estimator : least squares fit of the end times of the transfers against
+// their chunk numbers. the chunk numbers restart with each segment of continuous
+// capture, the fit has one slope for all the segments and one offset per segment
+// kept across windows and capture restarts, from platform_get_client on
+//
+struct spi_clock {
+	// current segment : points, chunk number of the last one, time of the first
+	// and of the last one
+	uint32_t n;
+	uint32_t chunks;
+	uint64_t t0;
+	uint64_t last;
+	// current segment : means and centred sums of squares and products
+	double mean_x, mean_y;
+	double sxx, sxy, syy;
+	// closed segments
+	double pooled_sxx, pooled_sxy, pooled_syy;
+	uint32_t points;
+	uint32_t segments;
+	uint32_t total_chunks;
+	// ns per chunk, 0 until measured, and spi frequency in Hz of the last
+	// estimate published in measured_spi_frequency, 0 until then
+	double chunk_ns;
+	uint32_t frequency;
+	uint8_t stable;
+	// once stable : fitted time of chunk 0 of the current segment, largest
+	// residual accepted, chunk number of the last check, windows off in a row
+	double offset;
+	double limit;
+	uint32_t checked;
+	uint32_t outliers;
+};
+
 struct spi {
+	// source of the chunks, fd is polled until chunks are ready
+	const struct vd628x_backend * backend;
+	void * device;
 	int fd;
 	uint32_t sampling_frequency;
 	uint16_t pdm_data_sample_width_in_bytes;
@@ -41,14 +159,59 @@ struct spi {
 	//char raw[SPI_BUFFER_SIZE]; // SPI_BUFFER_SIZE must be a multiple of chunk_size
 	//char * raw;
 	int transfers_done;  // in chunk_size transfers
+	uint16_t batch_transfers;  // max chunks per read, 1 if the driver has no batched transfers
+	uint16_t batch_max;        // max chunks accounted at once
 	pthread_mutex_t platform_mutex;
 	uint32_t spi_max_frequency;
 	uint32_t spi_speed_hz;
 #ifdef LOCALLY_MEASURED_SPI_FREQUENCY
-	struct timespec transfer_start_time;
-	struct timespec transfer_end_time;
+	struct spi_clock clock;
 #endif
-	uint16_t measured_spi_frequency;
+	uint32_t measured_spi_frequency;  // in Hz
+	// end time of each chunk, taken when its transfer completes. chunks of the
+	// hop ring or of the mapped ring are timed in ring_times, at the same position
+	uint64_t chunk_period_ns;
+	uint64_t * ring_times;
+	// hop mode : once the ramp is done, chunks are kept in a ring of 1 second
+	// and the latest second is published every hop_transfers chunks (0 : no hop)
+	uint16_t hop_transfers;
+	uint16_t ring_pos;     // chunk of the ring written by the next transfer
+	uint16_t ring_chunks;  // chunks in the ring, up to max_transfers[2]
+	int16_t * ring;
+	// ring mapped from the driver : chunks are accounted for in place, without
+	// read_chunks, and the windows are copied out of the ring when published
+	// map_pos is the position of the next chunk to account for
+	uint8_t mapped;
+	struct vd628x_ring map;
+	uint32_t map_pos;
+	uint32_t map_overruns;
+	// capture ring : windows go from the capture thread to the flicker detect thread
+	// through full_queue, and come back through free_queue once analysed
+	// the capture parameters above are changed while the capture thread is paused
+	struct platform_buffer buffers[PLATFORM_BUFFERS_NB];
+	struct platform_queue full_queue;
+	struct platform_queue free_queue;
+	sem_t full_sem;                     // posted for each window in full_queue
+	struct platform_buffer * filling;   // capture thread only
+	struct platform_buffer * held;      // flicker detect thread only
+	uint32_t sequence;
+	atomic_uint overruns;    // windows dropped because no buffer was free
+	atomic_uint high_water;  // max number of windows waiting in full_queue
+	atomic_uint stalls;      // PLATFORM_STALL_TIMEOUT_MS periods without chunk
+	// recording of the captured chunks, changed while the capture thread is paused
+	// a stopped recording is still written until the next one starts or the stop
+	struct vd628x_recorder * recorder;
+	struct vd628x_recorder * recorder_stopped;
+	// capture thread, paused while the capture parameters change
+	// cancel_fd wakes it up when it waits for the device
+	pthread_t capture_thread;
+	int cancel_fd;
+	int capture_cpu;  // -1 : no affinity
+	atomic_int capture_runs;
+	atomic_int capture_error;  // the capture stopped on error : platform_get_samples returns -1
+	atomic_int pause_request;  // number of capture_pause not resumed yet
+	uint8_t paused;   // protected by platform_mutex
+	pthread_cond_t capture_cond;
 
 };
 
@@ -63,108 +226,913 @@ struct client {
 
 
 //
-// spi_grab
-// low level funtion responsible for capture raw data from spi bus in internally allocated buffer
+// queue_reset
+// both threads must be out of the queue
 //
-int platform_chunck_transfer_and_get_samples(void *client, int16_t *samples)
+static void queue_reset(struct platform_queue *q)
 {
-	struct client *c = client;
-	struct spi *spi = &c->spi;
-	int ret;
-	time_t dif_sec = 0;
-	uint64_t dif_nsec = 0;
+	atomic_store(&q->head, 0);
+	atomic_store(&q->tail, 0);
+}
+
+//
+// queue_push
+// producer side. returns -1 if the queue is full
+//
+static int queue_push(struct platform_queue *q, struct platform_buffer *b)
+{
+	unsigned int tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	unsigned int next = (tail + 1) % PLATFORM_QUEUE_SLOTS;
 
-	if (spi->transfers_done == (spi->max_transfers[spi->index])) {
-		// not supposed to happen with this implementation : see client flk_detect.c
+	if (next == atomic_load_explicit(&q->head, memory_order_acquire))
 		return -1;
+
+	q->slots[tail] = b;
+	// the slot and the buffer content are visible to the consumer before the new tail
+	atomic_store_explicit(&q->tail, next, memory_order_release);
+
+	return 0;
+}
+
+//
+// queue_pop
+// consumer side. returns NULL if the queue is empty
+//
+static struct platform_buffer * queue_pop(struct platform_queue *q)
+{
+	unsigned int head = atomic_load_explicit(&q->head, memory_order_relaxed);
+	struct platform_buffer *b;
+
+	if (head == atomic_load_explicit(&q->tail, memory_order_acquire))
+		return NULL;
+
+	b = q->slots[head];
+	// the slot is read before the producer can write it again
+	atomic_store_explicit(&q->head, (head + 1) % PLATFORM_QUEUE_SLOTS, memory_order_release);
+
+	return b;
+}
+
+//
+// queue_depth
+// number of buffers in the queue. can be called from any thread
+//
+static unsigned int queue_depth(struct platform_queue *q)
+{
+	unsigned int tail = atomic_load(&q->tail);
+	unsigned int head = atomic_load(&q->head);
+
+	return (tail + PLATFORM_QUEUE_SLOTS - head) % PLATFORM_QUEUE_SLOTS;
+}
+
+//
+// monotonic_ns
+//
+static uint64_t monotonic_ns(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+//
+// chunks_slots
+// where the chunks just captured are : samples and times of a ring of size
+// chunks, from chunk first on
+//
+static void chunks_slots(struct spi *spi, int16_t **psamples, uint64_t **ptimes, uint32_t *psize, uint32_t *pfirst)
+{
+	if (spi->mapped) {
+		*psamples = spi->map.chunks;
+		*ptimes = spi->ring_times;
+		*psize = spi->map.header->chunks_nb;
+		*pfirst = spi->map_pos % *psize;
+	}
+	else if (spi->hop_transfers && (spi->index == 2)) {
+		*psamples = spi->ring;
+		*ptimes = spi->ring_times;
+		*psize = spi->max_transfers[2];
+		*pfirst = spi->ring_pos;
 	}
+	else {
+		*psamples = spi->filling->samples;
+		*ptimes = spi->filling->chunk_times;
+		*psize = spi->max_transfers[2];
+		*pfirst = spi->transfers_done;
+	}
+}
 
-	ret = ioctl(spi->fd, VD628x_IOCTL_GET_CHUNK_SAMPLES, &samples[spi->transfers_done * spi->samples_nb_per_chunk]);
-	if (ret)
-		return -1;
+//
+// stamp_chunks
+// times the chunks_nb chunks just captured. a batch holds chunks captured one
+// chunk period apart : the last one ends now
+//
+static void stamp_chunks(struct spi *spi, int chunks_nb, uint64_t now)
+{
+	int16_t * samples;
+	uint64_t * times;
+	uint32_t first, size;
+	int i;
+
+	chunks_slots(spi, &samples, &times, &size, &first);
+
+	for (i = 0; i < chunks_nb; i++)
+		times[(first + i) % size] = now - (uint64_t)(chunks_nb - 1 - i) * spi->chunk_period_ns;
+}
+
+//
+// record_chunks
+// hands the chunks_nb chunks just captured and timed over to the recorder
+// chunks of the mapped ring may wrap around its end
+//
+static void record_chunks(struct spi *spi, int chunks_nb)
+{
+	int16_t * samples;
+	uint64_t * times;
+	uint32_t first, size, n;
+
+	chunks_slots(spi, &samples, &times, &size, &first);
+
+	n = MIN((uint32_t)chunks_nb, size - first);
+	vd628x_recorder_put(spi->recorder, &samples[first * spi->samples_nb_per_chunk], &times[first],
+		(uint16_t)n, spi->samples_nb_per_chunk, spi->sampling_frequency, spi->measured_spi_frequency);
+	if (n < (uint32_t)chunks_nb)
+		vd628x_recorder_put(spi->recorder, samples, times,
+			(uint16_t)(chunks_nb - n), spi->samples_nb_per_chunk, spi->sampling_frequency, spi->measured_spi_frequency);
+}
 
 #ifdef LOCALLY_MEASURED_SPI_FREQUENCY
-	if (spi->transfers_done == 0) {
-		// get time at the end of the first transfer
-		clock_gettime(CLOCK_REALTIME, &spi->transfer_start_time);
-		//LOG("Measured SPI frequency. Start = %lu\n", spi->transfer_start_time.tv_nsec);
-	}
-	else if (spi->transfers_done == (spi->max_transfers[spi->index]-1)) {
-		// get time at the end of the last but one transfer
-		clock_gettime(CLOCK_REALTIME, &spi->transfer_end_time);
-		dif_sec = spi->transfer_end_time.tv_sec - spi->transfer_start_time.tv_sec;
-		//LOG("Measured SPI frequency. dif_sec = %lu\n", dif_sec);
-		//LOG("Measured SPI frequency. End = %lu\n", spi->transfer_end_time.tv_nsec);
-		dif_nsec = (uint64_t)dif_sec*1000000000 + spi->transfer_end_time.tv_nsec - spi->transfer_start_time.tv_nsec;
-		//LOG("Measured SPI frequency. dif_nsec = %lu\n", dif_nsec);
-		spi->measured_spi_frequency = (uint16_t)(((uint64_t)spi->max_transfers[spi->index]-1)*(spi->chunk_size)*8*1000000 / dif_nsec);
-		LOG("FLICKER : max, speed, measured : local, %d, %d, %d\n", spi->spi_max_frequency/1000, spi->spi_speed_hz/1000, spi->measured_spi_frequency);
+//
+// clock_segment_close
+// the next chunks are not continuous with the previous ones : chunks were lost,
+// the bus stalled or the capture was paused. the estimate is kept
+//
+static void clock_segment_close(struct spi_clock *clock)
+{
+	if (clock->n == 0)
+		return;
+
+	clock->pooled_sxx += clock->sxx;
+	clock->pooled_sxy += clock->sxy;
+	clock->pooled_syy += clock->syy;
+	clock->segments++;
+
+	clock->n = 0;
+	clock->chunks = 0;
+	clock->mean_x = 0;
+	clock->mean_y = 0;
+	clock->sxx = 0;
+	clock->sxy = 0;
+	clock->syy = 0;
+}
+
+//
+// clock_check
+// once the estimate is stable, checks the transfers against the fit once per
+// window. the chunk_ns and frequency of a fit that no longer matches the chunk
+// times are kept until clock_add measures them again
+//
+static void clock_check(struct spi *spi, int chunks_nb, uint64_t now)
+{
+	struct spi_clock *clock = &spi->clock;
+	double r, chunk_ns;
+	uint32_t frequency;
+
+	if ((clock->n == 0) || ((double)(now - clock->last) > (chunks_nb + 2) * clock->chunk_ns)) {
+		// new segment : its offset is taken from its first transfer
+		clock_segment_close(clock);
+		clock->n = 1;
+		clock->t0 = now;
+		clock->last = now;
+		clock->chunks = chunks_nb;
+		clock->checked = chunks_nb;
+		clock->offset = -clock->chunk_ns * chunks_nb;
+		return;
+	}
+	clock->last = now;
+	clock->chunks += chunks_nb;
+	if (clock->chunks - clock->checked < spi->max_transfers[2])
+		return;
+	clock->checked = clock->chunks;
+
+	r = (double)(now - clock->t0) - clock->offset - clock->chunk_ns * clock->chunks;
+	if (fabs(r) <= clock->limit) {
+		clock->outliers = 0;
+		return;
+	}
+	if (++clock->outliers < PLATFORM_SPI_CLOCK_OUTLIERS)
+		return;
+
+	LOG("FLICKER : spi clock off by %d us, frequency measured again\n", (int)(r / 1000));
+	chunk_ns = clock->chunk_ns;
+	frequency = clock->frequency;
+	memset(clock, 0, sizeof(struct spi_clock));
+	clock->chunk_ns = chunk_ns;
+	clock->frequency = frequency;
+}
+
+//
+// clock_add
+// accounts for a transfer of chunks_nb chunks ended at now, and updates the
+// spi frequency. once the estimate is stable, clock_check only watches it
+//
+static void clock_add(struct spi *spi, int chunks_nb, uint64_t now)
+{
+	struct spi_clock *clock = &spi->clock;
+	double x, y, dx, dy, sxx, sxy, rss, se, period;
+	uint32_t dof;
+
+	if (clock->stable) {
+		clock_check(spi, chunks_nb, now);
+		return;
+	}
+
+	// the chunks took longer than their duration and 2 chunks more : the
+	// producer stopped meanwhile, this transfer starts a new segment
+	period = clock->chunk_ns ? clock->chunk_ns : spi->chunk_period_ns;
+	if (clock->n && ((double)(now - clock->last) > (chunks_nb + 2) * period))
+		clock_segment_close(clock);
+
+	if (clock->n == 0)
+		clock->t0 = now;
+	clock->last = now;
+	clock->chunks += chunks_nb;
+	clock->total_chunks += chunks_nb;
+
+	// running means and centred sums, without loss of precision over long segments
+	x = clock->chunks;
+	y = (double)(now - clock->t0);
+	clock->n++;
+	clock->points++;
+	dx = x - clock->mean_x;
+	dy = y - clock->mean_y;
+	clock->mean_x += dx / clock->n;
+	clock->mean_y += dy / clock->n;
+	clock->sxx += dx * (x - clock->mean_x);
+	clock->sxy += dx * (y - clock->mean_y);
+	clock->syy += dy * (y - clock->mean_y);
+
+	sxx = clock->pooled_sxx + clock->sxx;
+	sxy = clock->pooled_sxy + clock->sxy;
+	if ((sxx <= 0) || (sxy <= 0))
+		return;
+
+	clock->chunk_ns = sxy / sxx;
+
+	// one offset per segment and the slope are fitted
+	if ((clock->points < clock->segments + 3) || (clock->total_chunks < spi->max_transfers[2]))
+		return;
+	dof = clock->points - clock->segments - 2;
+	rss = clock->pooled_syy + clock->syy - clock->chunk_ns * sxy;
+	se = sqrt(((rss > 0) ? rss : 0) / dof / sxx);
+
+	// the first transfers give estimates off by up to a percent
+	if (se < clock->chunk_ns * PLATFORM_SPI_CLOCK_PUBLISH_PPM / 1000000) {
+		clock->frequency = (uint32_t)(spi->chunk_size * 8 * 1e9 / clock->chunk_ns);
+		spi->measured_spi_frequency = clock->frequency;
+	}
+
+	if (clock->total_chunks < PLATFORM_SPI_CLOCK_MIN_SECONDS * spi->max_transfers[2])
+		return;
+	if (se < clock->chunk_ns * PLATFORM_SPI_CLOCK_PPM / 1000000) {
+		clock->stable = 1;
+		clock->offset = clock->mean_y - clock->chunk_ns * clock->mean_x;
+		clock->limit = PLATFORM_SPI_CLOCK_SIGMAS * sqrt(((rss > 0) ? rss : 0) / dof);
+		if (clock->limit < PLATFORM_SPI_CLOCK_RESIDUAL_MIN_NS)
+			clock->limit = PLATFORM_SPI_CLOCK_RESIDUAL_MIN_NS;
+		clock->checked = clock->chunks;
+		clock->outliers = 0;
+		LOG("FLICKER : spi frequency %d Hz, stable after %d transfers\n", spi->measured_spi_frequency, clock->points);
+	}
+}
+#endif
+
+//
+// publish_window
+// the buffer being filled holds a complete window : it is queued for analysis
+// and the capture goes on in a free buffer. if none is free, the window is
+// dropped, counted as an overrun, and the capture goes on in the same buffer
+//
+static void publish_window(struct spi *spi)
+{
+	struct platform_buffer * next = queue_pop(&spi->free_queue);
+	unsigned int depth;
+
+	spi->transfers_done = 0;
+
+	if (next == NULL) {
+		atomic_fetch_add(&spi->overruns, 1);
+		LOG("FLICKER : capture overrun, window %d dropped. %d overruns\n", spi->sequence, atomic_load(&spi->overruns));
+		return;
 	}
+
+	spi->filling->index = spi->index;
+	spi->filling->sequence = spi->sequence++;
+	spi->filling->spi_frequency = spi->measured_spi_frequency;
+	// from the start of the first chunk to the end of the last one
+	spi->filling->timestamp = (spi->filling->chunk_times[0] - spi->chunk_period_ns +
+		spi->filling->chunk_times[spi->max_transfers[spi->index] - 1]) / 2;
+	// cannot fail : full_queue has a slot for every buffer
+	queue_push(&spi->full_queue, spi->filling);
+	sem_post(&spi->full_sem);
+	spi->filling = next;
+
+	depth = queue_depth(&spi->full_queue);
+	if (depth > atomic_load(&spi->high_water))
+		atomic_store(&spi->high_water, depth);
+
+	// the 0.25 and 0.5 second windows are captured once, then 1 second windows
+	if (spi->index < 2)
+		spi->index++;
+}
+
+//
+// batch_chunks
+// number of chunks of the next transfer : up to batch_max, without going past
+// the end of the window, the end of the hop ring or the next hop
+//
+static uint16_t batch_chunks(struct spi *spi)
+{
+	uint16_t window = spi->max_transfers[2];
+	uint32_t n;
+
+	if (spi->hop_transfers && (spi->index == 2)) {
+		n = window - spi->ring_pos;
+		if (spi->ring_chunks < window)
+			n = MIN(n, (uint32_t)(window - spi->ring_chunks));
+		else
+			n = MIN(n, (uint32_t)(spi->hop_transfers - spi->transfers_done));
+	}
+	else
+		n = spi->max_transfers[spi->index] - spi->transfers_done;
+
+	return (uint16_t)MIN(n, spi->batch_max);
+}
+
+//
+// hop_chunks_done
+// hop mode accounting of the chunks_nb chunks captured in the ring
+// returns 1 when a window of the last second of samples is to be published
+//
+static int hop_chunks_done(struct spi *spi, uint16_t chunks_nb)
+{
+	uint16_t window = spi->max_transfers[2];
+
+	spi->ring_pos = (spi->ring_pos + chunks_nb) % window;
+	spi->ring_chunks = MIN(spi->ring_chunks + chunks_nb, window);
+	spi->transfers_done += chunks_nb;
+
+	// first window once the ring is full, then one window every hop
+	if ((spi->ring_chunks < window) || (spi->transfers_done < spi->hop_transfers))
+		return 0;
+
+	return 1;
+}
+
+//
+// chunks_done
+// accounting of the chunks_nb chunks captured in the buffer being filled
+// returns 1 when the buffer holds a complete window
+//
+static int chunks_done(struct spi *spi, uint16_t chunks_nb)
+{
+	// the 0.25 and 0.5 second windows of the ramp are always captured one after the other
+	if (spi->hop_transfers && (spi->index == 2))
+		return hop_chunks_done(spi, chunks_nb);
+
+	spi->transfers_done += chunks_nb;
+	if (spi->transfers_done < spi->max_transfers[spi->index])
+		return 0;
+
+#ifdef LOCALLY_MEASURED_SPI_FREQUENCY
+	LOG("FLICKER : max, speed, measured : local, %d, %d, %d\n", spi->spi_max_frequency/1000, spi->spi_speed_hz/1000, spi->measured_spi_frequency/1000);
 #else
-	if (spi->transfers_done == (spi->max_transfers[spi->index]-1))
-		LOG("FLICKER : max, speed, default : fixed, %d, %d, %d\n", spi->spi_max_frequency/1000, spi->spi_speed_hz/1000, spi->measured_spi_frequency);
+	LOG("FLICKER : max, speed, default : fixed, %d, %d, %d\n", spi->spi_max_frequency/1000, spi->spi_speed_hz/1000, spi->measured_spi_frequency/1000);
 #endif
 
+	return 1;
+}
+
+//
+// copy_times
+// copies window chunk times of a ring of size chunk times, starting at first
+//
+static void copy_times(uint64_t * dst, const uint64_t * times, uint32_t size, uint32_t first, uint16_t window)
+{
+	uint32_t n = MIN((uint32_t)window, size - first);
+
+	memcpy(dst, &times[first], n * sizeof(uint64_t));
+	memcpy(&dst[n], times, (window - n) * sizeof(uint64_t));
+}
 
-	//if (spi->transfers_done == (spi->max_transfers[spi->index])) {
-	if (spi->transfers_done == (spi->max_transfers[spi->index])-1) {
-		return 1;
+//
+// copy_window
+// copies the samples and chunk times of the complete window to the buffer being
+// filled, oldest chunk first. chunks read by read_chunks go straight to the
+// buffer, except in hop mode
+//
+static void copy_window(struct spi *spi)
+{
+	uint16_t window = spi->max_transfers[spi->index];
+	uint32_t chunk_nb = spi->samples_nb_per_chunk;
+	uint32_t size;
+
+	if (spi->mapped) {
+		vd628x_ring_copy(&spi->map, spi->filling->samples, spi->map_pos - window, window);
+		size = spi->map.header->chunks_nb;
+		copy_times(spi->filling->chunk_times, spi->ring_times, size, (spi->map_pos - window) % size, window);
+	}
+	else if (spi->hop_transfers && (spi->index == 2)) {
+		memcpy(spi->filling->samples, &spi->ring[spi->ring_pos * chunk_nb], (window - spi->ring_pos) * chunk_nb * sizeof(int16_t));
+		memcpy(&spi->filling->samples[(window - spi->ring_pos) * chunk_nb], spi->ring, spi->ring_pos * chunk_nb * sizeof(int16_t));
+		copy_times(spi->filling->chunk_times, spi->ring_times, window, spi->ring_pos, window);
+	}
+}
+
+//
+// wait_device
+// waits for chunks from the device, a pause or the stop of the capture
+// returns WAIT_READY, WAIT_CANCELLED, WAIT_TIMEOUT if no chunk arrived
+// within PLATFORM_STALL_TIMEOUT_MS, WAIT_ERROR
+//
+static int wait_device(struct spi *spi)
+{
+	struct pollfd pfd[2];
+	uint64_t count;
+	int ret;
+
+	pfd[0].fd = spi->fd;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = spi->cancel_fd;
+	pfd[1].events = POLLIN;
+
+	ret = poll(pfd, 2, PLATFORM_STALL_TIMEOUT_MS);
+	if (ret < 0)
+		return (errno == EINTR) ? WAIT_CANCELLED : WAIT_ERROR;
+
+	if (pfd[1].revents & POLLIN) {
+		// the capture loop checks the pause and stop requests
+		if (read(spi->cancel_fd, &count, sizeof(count)) < 0)
+			return WAIT_ERROR;
+		return WAIT_CANCELLED;
+	}
+
+	if (ret == 0)
+		return WAIT_TIMEOUT;
+
+	if (pfd[0].revents & (POLLERR | POLLHUP | POLLNVAL))
+		return WAIT_ERROR;
+
+	if (spi->backend->poll_ack != NULL)
+		spi->backend->poll_ack(spi->device);
+
+	return WAIT_READY;
+}
+
+//
+// cancel_wait
+// wakes the capture thread up if it waits for the device
+//
+static void cancel_wait(struct spi *spi)
+{
+	uint64_t count = 1;
+
+	if (write(spi->cancel_fd, &count, sizeof(count)) < 0)
+		LOG("Warning : could not wake the capture thread up\n");
+}
+
+//
+// capture_stall
+// no chunk for PLATFORM_STALL_TIMEOUT_MS : the samples of the window
+// being captured are not continuous anymore, it restarts
+//
+static void capture_stall(struct spi *spi)
+{
+	atomic_fetch_add(&spi->stalls, 1);
+	LOG("FLICKER : no spi chunk for %d ms, bus stalled. %d stalls\n", PLATFORM_STALL_TIMEOUT_MS, atomic_load(&spi->stalls));
+
+	spi->transfers_done = 0;
+	spi->ring_chunks = 0;
+	if (spi->mapped)
+		vd628x_ring_release(&spi->map, spi->map_pos);
+#ifdef LOCALLY_MEASURED_SPI_FREQUENCY
+	clock_segment_close(&spi->clock);
+#endif
+}
+
+//
+// wait_mapped_chunks
+// number of chunks of the mapped ring to account for, up to batch_chunks
+// returns 0 if none arrived, -1 on error
+//
+static int wait_mapped_chunks(struct spi *spi)
+{
+	uint32_t available, overruns;
+	int ret;
+
+	available = vd628x_ring_available(&spi->map, spi->map_pos);
+	if (available == 0) {
+		ret = wait_device(spi);
+		if (ret == WAIT_ERROR)
+			return -1;
+		if (ret == WAIT_TIMEOUT)
+			capture_stall(spi);
+		available = vd628x_ring_available(&spi->map, spi->map_pos);
+	}
+
+	// chunks dropped by the driver : the window being captured is not
+	// continuous anymore, it restarts after the chunks already written
+	overruns = vd628x_ring_overruns(&spi->map);
+	if (overruns != spi->map_overruns) {
+		LOG("FLICKER : %d chunks dropped by the driver, window restarted\n", overruns - spi->map_overruns);
+		spi->map_overruns = overruns;
+		spi->map_pos += available;
+		vd628x_ring_release(&spi->map, spi->map_pos);
+		spi->transfers_done = 0;
+		spi->ring_chunks = 0;
+#ifdef LOCALLY_MEASURED_SPI_FREQUENCY
+		clock_segment_close(&spi->clock);
+#endif
+		return 0;
+	}
+
+	return MIN(available, batch_chunks(spi));
+}
+
+//
+// release_mapped_chunks
+// gives back to the driver the chunks that are not part of the window being captured
+//
+static void release_mapped_chunks(struct spi *spi)
+{
+	uint32_t kept;
+
+	if (spi->hop_transfers && (spi->index == 2))
+		kept = spi->ring_chunks;
+	else
+		kept = spi->transfers_done;
+
+	vd628x_ring_release(&spi->map, spi->map_pos - kept);
+}
+
+//
+// platform_set_thread_cpu
+// binds the calling thread to a cpu
+//
+int platform_set_thread_cpu(int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	// pid 0 is the calling thread
+	if (sched_setaffinity(0, sizeof(set), &set)) {
+		LOG("Warning : could not bind thread to cpu %d\n", cpu);
+		return -1;
 	}
-	spi->transfers_done += 1;
 
 	return 0;
 }
 
+//
+// capture_routine
+// capture thread : chunks are transferred without interruption while windows
+// are analysed by the flicker detect thread. no lock is taken on the capture path,
+// platform_mutex is only used to pause the thread
+//
+static void *capture_routine(void * arg)
+{
+	struct spi *spi = arg;
+	int16_t * target;
+	int chunks_nb;
+	uint64_t now;
+
+	if (spi->capture_cpu >= 0)
+		platform_set_thread_cpu(spi->capture_cpu);
+
+	while (atomic_load(&spi->capture_runs)) {
+
+		// capture parameters are being changed
+		if (atomic_load(&spi->pause_request)) {
+			pthread_mutex_lock(&spi->platform_mutex);
+			spi->paused = 1;
+			pthread_cond_broadcast(&spi->capture_cond);
+			while (atomic_load(&spi->pause_request) && atomic_load(&spi->capture_runs))
+				pthread_cond_wait(&spi->capture_cond, &spi->platform_mutex);
+			spi->paused = 0;
+			pthread_mutex_unlock(&spi->platform_mutex);
+#ifdef LOCALLY_MEASURED_SPI_FREQUENCY
+			clock_segment_close(&spi->clock);
+#endif
+			continue;
+		}
+
+		if (spi->mapped) {
+			// chunks are already in memory, no transfer
+			chunks_nb = wait_mapped_chunks(spi);
+		}
+		else {
+			if (spi->hop_transfers && (spi->index == 2))
+				target = &spi->ring[spi->ring_pos * spi->samples_nb_per_chunk];
+			else
+				target = &spi->filling->samples[spi->transfers_done * spi->samples_nb_per_chunk];
+
+			chunks_nb = spi->backend->read_chunks(spi->device, target, batch_chunks(spi));
+			if (chunks_nb == 0) {
+				// no chunk ready : wait for one, for a pause or for the stop
+				switch (wait_device(spi)) {
+				case WAIT_TIMEOUT:
+					capture_stall(spi);
+					break;
+				case WAIT_ERROR:
+					chunks_nb = -1;
+					break;
+				}
+			}
+		}
+
+		if (chunks_nb < 0) {
+			LOG("FATAL error : error returned by the chunk samples transfer\n");
+			atomic_store(&spi->capture_error, 1);
+			break;
+		}
+		if (chunks_nb == 0)
+			continue;
+
+		now = monotonic_ns();
+		stamp_chunks(spi, chunks_nb, now);
+#ifdef LOCALLY_MEASURED_SPI_FREQUENCY
+		clock_add(spi, chunks_nb, now);
+#endif
+		if (spi->recorder != NULL)
+			record_chunks(spi, chunks_nb);
+		if (spi->mapped)
+			spi->map_pos += chunks_nb;
+
+		if (chunks_done(spi, chunks_nb)) {
+			copy_window(spi);
+			publish_window(spi);
+		}
+
+		if (spi->mapped)
+			release_mapped_chunks(spi);
+	}
+
+	atomic_store(&spi->capture_runs, 0);
+	// wake up the flicker detect thread waiting for a window or for the pause
+	sem_post(&spi->full_sem);
+	pthread_mutex_lock(&spi->platform_mutex);
+	pthread_cond_broadcast(&spi->capture_cond);
+	pthread_mutex_unlock(&spi->platform_mutex);
+
+	return NULL;
+}
+
+//
+// capture_pause
+// waits for the capture thread to be between two transfers and keeps it there
+// until capture_resume. the flicker detect and the api threads may both pause
+// it : it resumes with the last capture_resume
+//
+static void capture_pause(struct spi *spi)
+{
+	pthread_mutex_lock(&spi->platform_mutex);
+	atomic_fetch_add(&spi->pause_request, 1);
+	cancel_wait(spi);
+	while (atomic_load(&spi->capture_runs) && !spi->paused)
+		pthread_cond_wait(&spi->capture_cond, &spi->platform_mutex);
+	pthread_mutex_unlock(&spi->platform_mutex);
+}
+
+//
+// capture_resume
+//
+static void capture_resume(struct spi *spi)
+{
+	pthread_mutex_lock(&spi->platform_mutex);
+	if (atomic_fetch_sub(&spi->pause_request, 1) == 1)
+		pthread_cond_broadcast(&spi->capture_cond);
+	pthread_mutex_unlock(&spi->platform_mutex);
+}
 
 //
-// get_min_max_avg_remove_dc
+// reset_buffers
+// all the windows captured and not analysed are dropped
+// the capture thread must be paused, the flicker detect thread is the caller
+//
+static void reset_buffers(struct spi *spi)
+{
+	int i;
+
+	queue_reset(&spi->full_queue);
+	queue_reset(&spi->free_queue);
+	while (sem_trywait(&spi->full_sem) == 0)
+		;
+
+	spi->filling = &spi->buffers[0];
+	for (i = 1; i < PLATFORM_BUFFERS_NB; i++)
+		queue_push(&spi->free_queue, &spi->buffers[i]);
+	spi->held = NULL;
+	spi->transfers_done = 0;
+}
+
+//
+// free_buffers
+//
+static void free_buffers(struct spi *spi)
+{
+	int i;
+
+	for (i = 0; i < PLATFORM_BUFFERS_NB; i++) {
+		free(spi->buffers[i].samples);
+		spi->buffers[i].samples = NULL;
+		free(spi->buffers[i].chunk_times);
+		spi->buffers[i].chunk_times = NULL;
+	}
+	free(spi->ring_times);
+	spi->ring_times = NULL;
+}
+
+//
+// unmap_ring
+// stops the ring of the device
+//
+static void unmap_ring(struct spi *spi)
+{
+	if (!spi->mapped)
+		return;
+
+	spi->backend->unmap_ring(spi->device, &spi->map);
+	spi->mapped = 0;
+}
+
+//
+// map_ring
+// asks the device to capture in a ring of PLATFORM_RING_SECONDS seconds of chunks
+// and maps it. for a device without ring, chunks are then read by read_chunks
+// the capture thread must be paused
+//
+static void map_ring(struct spi *spi)
+{
+	uint32_t chunks_nb = PLATFORM_RING_SECONDS * spi->max_transfers[2];
+
+	unmap_ring(spi);
+	spi->batch_max = spi->batch_transfers;
+
+	if ((spi->backend->map_ring == NULL) ||
+		spi->backend->map_ring(spi->device, chunks_nb, &spi->map))
+		return;
+
+	// a ring smaller than a window would overrun before any window is complete
+	if ((spi->map.header->chunk_samples != spi->samples_nb_per_chunk) ||
+		(spi->map.header->chunks_nb > chunks_nb) ||
+		(spi->map.header->chunks_nb < spi->max_transfers[2])) {
+		LOG("Error. Could not use the spi sample ring. Chunks transferred by ioctl\n");
+		spi->backend->unmap_ring(spi->device, &spi->map);
+		return;
+	}
+
+	spi->mapped = 1;
+	spi->map_pos = vd628x_ring_consumer(&spi->map);
+	spi->map_overruns = vd628x_ring_overruns(&spi->map);
+	// the whole ring can be accounted for at once
+	spi->batch_max = spi->map.header->chunks_nb;
+	LOG("spi sample ring mapped : %d chunks\n", spi->map.header->chunks_nb);
+}
+
+//
+// platform_get_samples
+// waits for the next captured window. on success *psamples points to its samples
+// until platform_start_next_transfer is called
+// returns -1 if the capture stopped on error, 0 if the wait was cancelled by
+// platform_cancel_get_samples, 1 if a window is available
+//
+int platform_get_samples(void *client, int16_t **psamples)
+{
+	struct client *c = client;
+	struct spi *spi = &c->spi;
+	struct platform_buffer * next;
+
+	// windows are queued in capture order
+	next = NULL;
+	if (sem_wait(&spi->full_sem) == 0)
+		next = queue_pop(&spi->full_queue);
+
+	// the windows captured before a capture error are still analysed
+	if (next == NULL)
+		return atomic_load(&spi->capture_error) ? -1 : 0;
+
+	spi->held = next;
+	*psamples = next->samples;
+
+	return 1;
+}
+
+//
+// platform_cancel_get_samples
+// makes platform_get_samples return 0 now if it waits, or at its next call
+// can be called from any thread
+//
+void platform_cancel_get_samples(void *client)
+{
+	struct client *c = client;
+	struct spi *spi = &c->spi;
+
+	sem_post(&spi->full_sem);
+}
+
+//
+// platform_get_capture_stats
+// size of the queue of captured windows, windows in it now and at most,
+// windows dropped because the queue was full and spi bus stalls. can be called from any thread
+//
+void platform_get_capture_stats(void *client,
+		uint16_t * pqueue_size,
+		uint16_t * pqueue_depth,
+		uint16_t * pqueue_high_water,
+		uint32_t * poverruns,
+		uint32_t * pstalls)
+{
+	struct client *c = client;
+	struct spi *spi = &c->spi;
+
+	// the buffer being filled is never queued
+	*pqueue_size = PLATFORM_BUFFERS_NB - 1;
+	*pqueue_depth = (uint16_t)queue_depth(&spi->full_queue);
+	*pqueue_high_water = (uint16_t)atomic_load(&spi->high_water);
+	*poverruns = atomic_load(&spi->overruns);
+	*pstalls = atomic_load(&spi->stalls);
+}
+
+
+//
+// get_min_max_avg
 // Function called when spi raw data buffer is filled up
-// Counts the number of 1 within each PDM sample to generate sample for FFT
+// finds the min, max and average of the samples in a single pass. samples are left
+// untouched : the average is the DC that the FFT input preparation subtracts
+// STATS_LANES samples are processed per vector, with GCC vector extensions
+// so that the code stays portable between SSE and NEON
 //
-static void get_min_max_avg_remove_dc(void * client,
-		int16_t * samples,
+#define STATS_LANES 4
+
+typedef int32_t stats_vector __attribute__((vector_size(STATS_LANES * sizeof(int32_t))));
+
+static void get_min_max_avg(int16_t * samples,
+		uint32_t samples_nb,
 		uint16_t * pavgRawFlickerData,
 		uint16_t * pmaxRawFlickerData,
 		uint16_t * pminRawFlickerData)
 {
 	uint32_t s;
 	uint32_t avg = 0;
-	struct client *c = client;
-	struct spi *spi = &c->spi;
+	int32_t max = 0;
+	int32_t min = 0xFFFF;
+	stats_vector vmax = { 0, 0, 0, 0 };
+	stats_vector vmin = { 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF };
+	stats_vector vsum = { 0, 0, 0, 0 };
 
 #ifdef LOG_SAMPLES
 	static uint32_t count = 0;
 #endif
-	*pmaxRawFlickerData = 0;
-	*pminRawFlickerData = 0xFFFF;
-	*pavgRawFlickerData = 0;
 
 	// find the min, and max values of the samples
 	// also calculate the sum for a further average calcultion
-	for(s = 0; s < spi->samples_number[spi->index]; s++) {
-		if (*samples > *pmaxRawFlickerData)
-			*pmaxRawFlickerData = *samples;
-		if (*samples < *pminRawFlickerData)
-			*pminRawFlickerData = *samples;
-		avg += *samples;
-		samples++;
+	for(s = 0; s + STATS_LANES <= samples_nb; s += STATS_LANES) {
+		stats_vector v = { samples[s], samples[s+1], samples[s+2], samples[s+3] };
+		stats_vector is_max = v > vmax;
+		stats_vector is_min = v < vmin;
+
+		vmax = (v & is_max) | (vmax & ~is_max);
+		vmin = (v & is_min) | (vmin & ~is_min);
+		vsum += v;
+	}
+	for(; s < samples_nb; s++) {
+		max = (samples[s] > max) ? samples[s] : max;
+		min = (samples[s] < min) ? samples[s] : min;
+		avg += samples[s];
+	}
+	for(s = 0; s < STATS_LANES; s++) {
+		max = (vmax[s] > max) ? vmax[s] : max;
+		min = (vmin[s] < min) ? vmin[s] : min;
+		avg += vsum[s];
 	}
 
+	*pmaxRawFlickerData = (uint16_t)max;
+	*pminRawFlickerData = (uint16_t)min;
+	*pavgRawFlickerData = 0;
+
 	// calculate average
-	avg /= spi->samples_number[spi->index];
+	avg /= samples_nb;
 	if (avg <= 0xFFFF)
 		*pavgRawFlickerData = (uint16_t)(avg);
 
-	// remove DC. this makes search of frequency peaks much easier once fft is performed
-	samples -= spi->samples_number[spi->index];
-	for(s = 0; s < spi->samples_number[spi->index]; s++) {
-		*samples -= *pavgRawFlickerData;
 #ifdef LOG_SAMPLES
-		LOG("sample %d,%d,%d,%d\n", count, s, spi->samples_number[spi->index], *samples);
+	for(s = 0; s < samples_nb; s++) {
+		LOG("sample %d,%d,%d,%d\n", count, s, samples_nb, samples[s] - *pavgRawFlickerData);
 		count++;
-#endif
-		samples++;
 	}
+#endif
 }
 
 
@@ -187,6 +1155,7 @@ void *platform_get_client()
 	res = (struct client *) malloc(sizeof(struct client));
 	if (!res)
 		goto malloc_error;
+	memset(res, 0, sizeof(struct client));
 
 	return (void *) res;
 
@@ -217,38 +1186,91 @@ int platform_set_fft_info(void *client, uint32_t sampling_frequency) {
 	struct client *c = client;
 	struct spi *spi = &c->spi;
 	struct vd628x_spi_params spi_params;
-	int err;
-
-	// lock
-	pthread_mutex_lock(&spi->platform_mutex);
+	int16_t *samples[PLATFORM_BUFFERS_NB];
+	int16_t *ring = NULL;
+	uint32_t samples_number[3];
+	uint16_t pdm_data_sample_width_in_bytes;
+	int err = 0, i;
 
-	spi->sampling_frequency = sampling_frequency;
-	spi->pdm_data_sample_width_in_bytes = SPI_BUFFER_SIZE_1_SEC_DATA/sampling_frequency;
+	// the new parameters and buffers are committed once the device is configured
+	// and all the buffers are allocated : on error, the capture goes on as before
+	pdm_data_sample_width_in_bytes = SPI_BUFFER_SIZE_1_SEC_DATA/sampling_frequency;
 
 	// 3 values of samples_number to handle FFT on 0.25, then 0.5 then 1 second of data
-	spi->samples_number[2] = SPI_BUFFER_SIZE/spi->pdm_data_sample_width_in_bytes;
-	spi->samples_number[1] = spi->samples_number[2]/2;
-	spi->samples_number[0] = spi->samples_number[1]/2;
+	samples_number[2] = SPI_BUFFER_SIZE/pdm_data_sample_width_in_bytes;
+	samples_number[1] = samples_number[2]/2;
+	samples_number[0] = samples_number[1]/2;
+
+	// the buffers hold 1 second of samples : their size follows the sampling frequency
+	// the samples after the 0.25 and 0.5 second windows are never read
+	for (i = 0; i < PLATFORM_BUFFERS_NB; i++) {
+		samples[i] = (int16_t *)malloc(samples_number[2] * sizeof(int16_t));
+		if (samples[i] == NULL)
+			err = -1;
+		if (spi->buffers[i].chunk_times == NULL)
+			spi->buffers[i].chunk_times = (uint64_t *)malloc(spi->max_transfers[2] * sizeof(uint64_t));
+		if (spi->buffers[i].chunk_times == NULL)
+			err = -1;
+	}
+	// the chunk times of the hop ring or of the mapped ring
+	if (spi->ring_times == NULL)
+		spi->ring_times = (uint64_t *)malloc(PLATFORM_RING_SECONDS * spi->max_transfers[2] * sizeof(uint64_t));
+	if (spi->ring_times == NULL)
+		err = -1;
+	if (err) {
+		LOG("FATAL error : Could not allocate the capture buffers\n");
+		goto free_samples;
+	}
 
-	spi->samples_nb_per_chunk = sampling_frequency / (SPI_BUFFER_SIZE_1_SEC_DATA / spi->chunk_size);
+	// the hop ring holds 1 second of samples : its size follows the sampling frequency
+	if (spi->hop_transfers) {
+		ring = (int16_t *)malloc(samples_number[2] * sizeof(int16_t));
+		if (ring == NULL)
+			LOG("Error. Could not allocate the hop mode ring\n");
+	}
+
+	// the capture thread is out of the buffers until capture_resume
+	capture_pause(spi);
 
 	spi_params.speed_hz = spi->spi_speed_hz;
-	spi_params.samples_nb_per_chunk = spi->samples_nb_per_chunk;
-	spi_params.pdm_data_sample_width_in_bytes = spi->pdm_data_sample_width_in_bytes;
-	err = ioctl(spi->fd, VD628x_IOCTL_SET_SPI_PARAMS, &spi_params);
+	spi_params.samples_nb_per_chunk = sampling_frequency / (SPI_BUFFER_SIZE_1_SEC_DATA / spi->chunk_size);
+	spi_params.pdm_data_sample_width_in_bytes = pdm_data_sample_width_in_bytes;
+	err = spi->backend->configure(spi->device, &spi_params);
 	if (err) {
-		LOG("FATAL error : error returned by VD628x_IOCTL_SET_SPI_PARAMS\n");
-		return -1;
+		LOG("Error. Could not configure the spi device for %d Hz\n", sampling_frequency);
+		capture_resume(spi);
+		free(ring);
+		goto free_samples;
 	}
 
+	spi->sampling_frequency = sampling_frequency;
+	spi->pdm_data_sample_width_in_bytes = pdm_data_sample_width_in_bytes;
+	for (i = 0; i < 3; i++)
+		spi->samples_number[i] = samples_number[i];
+	spi->samples_nb_per_chunk = spi_params.samples_nb_per_chunk;
+	for (i = 0; i < PLATFORM_BUFFERS_NB; i++) {
+		free(spi->buffers[i].samples);
+		spi->buffers[i].samples = samples[i];
+	}
+	spi->chunk_period_ns = 1000000000ULL / spi->max_transfers[2];
+
 	// platform_set_fft_info can be called dynamically because of client
 	// is allowed to provide a new sampling frequency dynamically
 	// set spi->index = 0 so that we restart flicker detect on 0.25, then 0.5 then 1s
 	spi->index = 0;
-	spi->transfers_done = 0;
+	reset_buffers(spi);
 
-	// unlock
-	pthread_mutex_unlock(&spi->platform_mutex);
+	// the chunk size of the driver ring follows the sampling frequency
+	map_ring(spi);
+
+	free(spi->ring);
+	spi->ring = ring;
+	if (ring == NULL)
+		spi->hop_transfers = 0;
+	spi->ring_pos = 0;
+	spi->ring_chunks = 0;
+
+	capture_resume(spi);
 
 	LOG("FLICKER FFT INFO for 1 second of PDM data \n");
 	LOG("        SPI buffer size : 0x%x\n", SPI_BUFFER_SIZE);
@@ -258,45 +1280,174 @@ int platform_set_fft_info(void *client, uint32_t sampling_frequency) {
 	LOG("        Samples Number : %d\n", spi->samples_number[2]);
 
 	return 0;
+
+free_samples:
+	for (i = 0; i < PLATFORM_BUFFERS_NB; i++)
+		free(samples[i]);
+	return -1;
 }
 
 //
-// platform_spi_start
-// function initalizing the data needed to start grabbing data from spi
+// platform_set_hop
+// function setting the period in ms at which 1 second windows are published once
+// the 0.25 and 0.5 second windows are done. 0 publishes one window per second of capture
+// the period is rounded down to a number of chunks
 //
-int platform_spi_start(void *client, uint32_t sampling_frequency)
-{
+int platform_set_hop(void *client, uint32_t hop_ms) {
 	struct client *c = client;
 	struct spi *spi = &c->spi;
-	struct vd628x_spi_info spi_info;
-	int err;
+	uint32_t hop_transfers = hop_ms * spi->max_transfers[2] / 1000;
+
+	if (hop_transfers > spi->max_transfers[2])
+		hop_transfers = spi->max_transfers[2];
+	if ((hop_ms != 0) && (hop_transfers == 0))
+		hop_transfers = 1;
+
+	capture_pause(spi);
+
+	if (hop_transfers && (spi->ring == NULL)) {
+		spi->ring = (int16_t *)malloc(spi->samples_number[2] * sizeof(int16_t));
+		if (spi->ring == NULL) {
+			LOG("Error. Could not allocate the hop mode ring\n");
+			capture_resume(spi);
+			return -1;
+		}
+	}
+	else if (hop_transfers == 0) {
+		free(spi->ring);
+		spi->ring = NULL;
+	}
 
-	spi->fd = open("/dev/vd628x_spi", O_RDONLY);
-	if (spi->fd < 0) {
-		LOG("FATAL error : Could not open /dev/vd628x_spi\n");
-		return -1;
+	// the ring restarts empty : the first window is published after 1 second
+	spi->hop_transfers = (uint16_t)hop_transfers;
+	spi->ring_pos = 0;
+	spi->ring_chunks = 0;
+	if (spi->index == 2)
+		spi->transfers_done = 0;
+
+	capture_resume(spi);
+
+	LOG("FLICKER hop : %d ms, %d chunks\n", hop_ms, spi->hop_transfers);
+
+	return 0;
+}
+
+//
+// platform_set_record
+// starts, or stops if record is 0, the recording of the captured chunks in a new
+// file of PLATFORM_RECORD_DIR. the file is written by the thread of the recorder :
+// the capture goes on while it is written
+// called from the api thread : creating the file and waiting for the end of the
+// previous recording would stall the flicker detect thread
+//
+int platform_set_record(void *client, int record) {
+	struct client *c = client;
+	struct spi *spi = &c->spi;
+	struct vd628x_recorder * recorder = NULL;
+	struct vd628x_recorder * previous;
+	char path[PATH_MAX];
+	struct tm date;
+	time_t now;
+
+	if ((record != 0) == (spi->recorder != NULL))
+		return 0;
+
+	// the previous recording is written until its end first
+	if (spi->recorder_stopped != NULL) {
+		vd628x_recorder_close(spi->recorder_stopped);
+		spi->recorder_stopped = NULL;
 	}
 
-	// set read from device in blocking mode
-	err = fcntl(spi->fd, F_SETFL, fcntl(spi->fd, F_GETFL, 0) &~O_NONBLOCK);
-	if (err) {
-		LOG("ERROR : Could not open /dev/vd6281_spi fe in read only \n");
-		close(spi->fd);
-		return -1;
+	if (record) {
+		now = time(NULL);
+		localtime_r(&now, &date);
+		snprintf(path, sizeof(path), "%s/vd628x_%04d%02d%02d_%02d%02d%02d.rec", PLATFORM_RECORD_DIR,
+			date.tm_year + 1900, date.tm_mon + 1, date.tm_mday, date.tm_hour, date.tm_min, date.tm_sec);
+		recorder = vd628x_recorder_open(path);
+		if (recorder == NULL) {
+			LOG("Error. Could not start the recording\n");
+			return -1;
+		}
 	}
 
-	err = ioctl(spi->fd, VD628x_IOCTL_GET_SPI_INFO, &spi_info);
-	if (err) {
-		LOG("FATAL error : error returned by VD628x_IOCTL_GET_SPI_INFO\n");
-		close(spi->fd);
-		return -1;
+	capture_pause(spi);
+	previous = spi->recorder;
+	spi->recorder = recorder;
+	capture_resume(spi);
+
+	if (previous != NULL) {
+		vd628x_recorder_stop(previous);
+		spi->recorder_stopped = previous;
 	}
+
+	return 0;
+}
+
+//
+// backends : the device name selects one by its prefix, the kernel device by default
+//
+static const struct vd628x_backend * const backends[] = {
+	&vd628x_backend_file,
+	&vd628x_backend_synthetic,
+	&vd628x_backend_ring,
+};
+
+//
+// get_backend
+//
+static const struct vd628x_backend * get_backend(const char * device)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(backends) / sizeof(backends[0]); i++)
+		if (strncmp(device, backends[i]->prefix, strlen(backends[i]->prefix)) == 0)
+			return backends[i];
+
+	return &vd628x_backend_kernel;
+}
+
+//
+// platform_probe_device
+// checks that the device can be opened : the sensor, or the backend replacing it, is there
+//
+int platform_probe_device(const char * device)
+{
+	const struct vd628x_backend * backend = get_backend(device);
+	struct vd628x_backend_info info;
+	void * context;
+
+	context = backend->open(device, &info);
+	if (context == NULL)
+		return -1;
+	backend->close(context);
+
+	return 0;
+}
+
+//
+// platform_spi_start
+// function initalizing the data needed to start grabbing data from spi
+// and starting the capture thread, bound to capture_cpu if not -1
+// chunks come from the backend of PLATFORM_SPI_DEVICE
+//
+int platform_spi_start(void *client, uint32_t sampling_frequency, int capture_cpu)
+{
+	struct client *c = client;
+	struct spi *spi = &c->spi;
+	struct vd628x_backend_info spi_info;
+	int err, i;
+
+	spi->backend = get_backend(PLATFORM_SPI_DEVICE);
+	spi->device = spi->backend->open(PLATFORM_SPI_DEVICE, &spi_info);
+	if (spi->device == NULL)
+		return -1;
+	spi->fd = spi->backend->poll_fd(spi->device);
 	LOG("spi chunk size : %d\n", spi_info.chunk_size);
 
 	if (spi_info.spi_max_frequency == 0) {
 		LOG("Error. Got 0 for spi frequency\n");
 		//free(spi->raw);
-		close(spi->fd);
+		spi->backend->close(spi->device);
 		return -1;
 	}
 	LOG("spi_max_frequency : %d\n", spi_info.spi_max_frequency);
@@ -310,34 +1461,78 @@ int platform_spi_start(void *client, uint32_t sampling_frequency)
 		spi->spi_speed_hz = spi_info.spi_max_frequency;
 
 	// set SPI speed with the required one.
-#ifndef LOCALLY_MEASURED_SPI_FREQUENCY
 	// If spi speed not locally measured, it is assumed it is the one set to the SPI bus
-	spi->measured_spi_frequency = spi->spi_speed_hz/1000;
+	// otherwise until the first estimate
+	spi->measured_spi_frequency = spi->spi_speed_hz;
+#ifdef LOCALLY_MEASURED_SPI_FREQUENCY
+	// estimate of a previous capture
+	if (spi->clock.frequency)
+		spi->measured_spi_frequency = spi->clock.frequency;
+	clock_segment_close(&spi->clock);
 #endif
 
 	// check chuck size fits the basic requiements
 	if (spi_info.chunk_size == 0) {
 		LOG("Error. Got 0 for spi chunk size\n");
-		close(spi->fd);
+		spi->backend->close(spi->device);
 		return -1;
 	}
 
 	//spi->raw = (char *)malloc(spi_info.chunk_size);
 	//if (spi->raw == NULL) {
 	//	LOG("Error. Could not allocated buffer for PDM raw data\n");
-	//	close(spi->fd);
+	//	spi->backend->close(spi->device);
 	//	return -1;
 	//}
 
 	if ((SPI_BUFFER_SIZE < spi_info.chunk_size) || (SPI_BUFFER_SIZE % spi_info.chunk_size != 0)) {
 		LOG("Error. chunk size not compatible with flicker detect requirements\n");
 		//free(spi->raw);
-		close(spi->fd);
+		spi->backend->close(spi->device);
+		return -1;
+	}
+
+	spi->cancel_fd = eventfd(0, EFD_NONBLOCK);
+	if (spi->cancel_fd < 0) {
+		LOG("Error. Could not create the capture cancel eventfd\n");
+		spi->backend->close(spi->device);
 		return -1;
 	}
 
-	// init and lock mutex
+	// init mutex, condition and semaphore
 	pthread_mutex_init(&spi->platform_mutex, NULL);
+	pthread_cond_init(&spi->capture_cond, NULL);
+	sem_init(&spi->full_sem, 0, 0);
+
+	// no hop until platform_set_hop is called
+	spi->hop_transfers = 0;
+	spi->ring = NULL;
+	// the driver ring is mapped by platform_set_fft_info
+	spi->mapped = 0;
+	spi->map.header = NULL;
+
+	// capture buffers are allocated by platform_set_fft_info
+	for (i = 0; i < PLATFORM_BUFFERS_NB; i++) {
+		spi->buffers[i].samples = NULL;
+		spi->buffers[i].chunk_times = NULL;
+	}
+	spi->ring_times = NULL;
+	spi->sequence = 0;
+	atomic_init(&spi->overruns, 0);
+	atomic_init(&spi->high_water, 0);
+	atomic_init(&spi->stalls, 0);
+	// no recording until platform_set_record is called
+	spi->recorder = NULL;
+	spi->recorder_stopped = NULL;
+	spi->capture_cpu = capture_cpu;
+	atomic_init(&spi->capture_runs, 0);
+	atomic_init(&spi->capture_error, 0);
+	atomic_init(&spi->pause_request, 0);
+	spi->paused = 0;
+
+	// one or several chunks per transfer
+	spi->batch_transfers = spi_info.batch_chunks;
+	spi->batch_max = spi->batch_transfers;
 
 	// init spi struct internal fields
 	spi->chunk_size = spi_info.chunk_size;
@@ -350,7 +1545,27 @@ int platform_spi_start(void *client, uint32_t sampling_frequency)
 	err = platform_set_fft_info(client, sampling_frequency);
 	if (err) {
 		//free(spi->raw);
-		close(spi->fd);
+		free_buffers(spi);
+		sem_destroy(&spi->full_sem);
+		pthread_cond_destroy(&spi->capture_cond);
+		pthread_mutex_destroy(&spi->platform_mutex);
+		close(spi->cancel_fd);
+		spi->backend->close(spi->device);
+		return -1;
+	}
+
+	// capture runs from now on, windows are analysed while the next ones are captured
+	atomic_store(&spi->capture_runs, 1);
+	err = pthread_create(&spi->capture_thread, NULL, capture_routine, spi);
+	if (err) {
+		LOG("FATAL error : capture thread create failed\n");
+		atomic_store(&spi->capture_runs, 0);
+		free_buffers(spi);
+		sem_destroy(&spi->full_sem);
+		pthread_cond_destroy(&spi->capture_cond);
+		pthread_mutex_destroy(&spi->platform_mutex);
+		close(spi->cancel_fd);
+		spi->backend->close(spi->device);
 		return -1;
 	}
 
@@ -361,7 +1576,7 @@ int platform_spi_start(void *client, uint32_t sampling_frequency)
 
 //
 // platform_start_next_transfer
-// function initalizing the data needed to start a new transfer.
+// function giving back the buffer of the analysed window to the capture.
 // This is called after FFT on the previous raw data of the spi buffer is completed
 //
 int platform_start_next_transfer(void * client) {
@@ -373,12 +1588,29 @@ int platform_start_next_transfer(void * client) {
 		LOG("FATAL Error. spi = null\n");
 		return -1;
 	}
-	// lock
-	pthread_mutex_lock(&spi->platform_mutex);
-	// transfers_done to 0 re-enables the transfer to spi buffer
-	spi->transfers_done = 0;
-	// unlock
-	pthread_mutex_unlock(&spi->platform_mutex);
+	// NULL if the buffers were reset meanwhile
+	if (spi->held != NULL) {
+		// cannot fail : free_queue has a slot for every buffer
+		queue_push(&spi->free_queue, spi->held);
+		spi->held = NULL;
+	}
+
+	return 0;
+}
+
+//
+// platform_get_samples_timestamp
+// CLOCK_MONOTONIC time in ns of the centre of the window held by the flicker detect thread
+//
+int platform_get_samples_timestamp(void *client, int16_t * data, uint64_t * ptimestamp)
+{
+	struct client *c = client;
+	struct spi *spi = &c->spi;
+
+	if ((spi->held == NULL) || (spi->held->samples != data))
+		return -1;
+
+	*ptimestamp = spi->held->timestamp;
 
 	return 0;
 }
@@ -387,6 +1619,7 @@ int platform_start_next_transfer(void * client) {
 // platform_analyze_samples
 // function generating the samples from the raw data of the spi buffer
 // and returning info so that upper layer can performed FFT on the sampples
+// DC is not removed from data : *pavgRawFlickerData is to be subtracted
 //
 int platform_get_samples_stats(void *client,
 		int16_t * data,
@@ -394,24 +1627,20 @@ int platform_get_samples_stats(void *client,
 		uint16_t * pmaxRawFlickerData,
 		uint16_t * pminRawFlickerData,
 		uint16_t * psamples_nb,
-		uint16_t * pactualSpiFrequency,
-		uint16_t * pdefaultSpiFrequency
+		uint16_t * pvalid_samples_nb,
+		uint32_t * pactualSpiFrequency,
+		uint32_t * pdefaultSpiFrequency
 		)
 {
 	struct client *c = client;
 	struct spi *spi = &c->spi;
 
-	// lock
-	pthread_mutex_lock(&spi->platform_mutex);
-
-	// if buffer not filled, exit
-	if (spi->transfers_done < (spi->max_transfers[spi->index]-1)) {
-		pthread_mutex_unlock(&spi->platform_mutex);
+	// if no window got by platform_get_samples, exit
+	if ((spi->held == NULL) || (spi->held->samples != data))
 		return -1;
-	}
 
 	// if buffer filled, process
-	get_min_max_avg_remove_dc(client, data, pavgRawFlickerData, pmaxRawFlickerData, pminRawFlickerData);
+	get_min_max_avg(data, spi->samples_number[spi->held->index], pavgRawFlickerData, pmaxRawFlickerData, pminRawFlickerData);
 
 	// once process is completed. we can enable transfers again to spi buffer
 	// lets cheat with the FFT so that we give data as if it was always 1 second of data
@@ -419,15 +1648,11 @@ int platform_get_samples_stats(void *client,
 	// but in case of good signal we should get the right flicker frequency with 1Hz accuracy
 	//*psamples_nb = spi->samples_number[spi->index];
 	*psamples_nb = spi->samples_number[2]; // 2 instead of [spi->index] see comment above
+	// number of real samples, the other ones up to *psamples_nb are to be taken as 0
+	*pvalid_samples_nb = spi->samples_number[spi->held->index];
 
-	if (spi->index<2)
-		spi->index++;
-
-	// unlock
-	pthread_mutex_unlock(&spi->platform_mutex);
-
-	*pactualSpiFrequency = spi->measured_spi_frequency;
-	*pdefaultSpiFrequency = DEFAULT_SPI_FREQUENCY/1000;
+	*pactualSpiFrequency = spi->held->spi_frequency;
+	*pdefaultSpiFrequency = DEFAULT_SPI_FREQUENCY;
 
 	return 0;
 }
@@ -441,10 +1666,35 @@ int platform_spi_stop(void *client)
 {
 	struct client *c = client;
 	struct spi *spi = &c->spi;
+	void *retval;
+
+	// stop the capture thread, woken up if it waits for the device
+	pthread_mutex_lock(&spi->platform_mutex);
+	atomic_store(&spi->capture_runs, 0);
+	cancel_wait(spi);
+	pthread_cond_broadcast(&spi->capture_cond);
+	pthread_mutex_unlock(&spi->platform_mutex);
+	pthread_join(spi->capture_thread, &retval);
+
+	LOG("FLICKER : capture queue high water mark %d of %d, %d windows dropped by overruns, %d bus stalls\n",
+		atomic_load(&spi->high_water), PLATFORM_BUFFERS_NB - 1, atomic_load(&spi->overruns), atomic_load(&spi->stalls));
 
+	sem_destroy(&spi->full_sem);
+	pthread_cond_destroy(&spi->capture_cond);
 	pthread_mutex_destroy(&spi->platform_mutex);
 	//free(spi->raw);
-	close(spi->fd);
+	if (spi->recorder != NULL)
+		vd628x_recorder_close(spi->recorder);
+	if (spi->recorder_stopped != NULL)
+		vd628x_recorder_close(spi->recorder_stopped);
+	spi->recorder = NULL;
+	spi->recorder_stopped = NULL;
+	unmap_ring(spi);
+	free_buffers(spi);
+	free(spi->ring);
+	spi->ring = NULL;
+	close(spi->cancel_fd);
+	spi->backend->close(spi->device);
 
 	return 0;
 }
@@ -9,24 +9,50 @@ This file is licensed under open source license ST SLA0103
 extern "C" {
 #endif
 
+// device of the flicker channel. can be overridden to capture from a fake device,
+// or without the sensor : "file:<path>" reads int16 samples from a file and
+// "synthetic:<Hz>" generates a flicker of the given frequency
+#ifndef PLATFORM_SPI_DEVICE
+#define PLATFORM_SPI_DEVICE "/dev/vd628x_spi"
+#endif
+
+// directory of the recordings of the flicker channel, see vd628x_recorder.h
+#ifndef PLATFORM_RECORD_DIR
+#define PLATFORM_RECORD_DIR "/data/local/tmp"
+#endif
+
 void *platform_get_client(/*int i2c_address_in_7_bits*/);
 void platform_put_client(void *client);
 
-int platform_spi_start(void *client, uint32_t sampling_frequency);
+int platform_probe_device(const char * device);
+int platform_spi_start(void *client, uint32_t sampling_frequency, int capture_cpu);
 int platform_get_samples_stats(void *client,
 			int16_t * samples,
 			uint16_t * pavgRawFlickerData,
 			uint16_t * pmaxRawFlickerData,
 			uint16_t * pminRawFlickerData,
 			uint16_t * psamples_nb,
-			uint16_t * pactualSpiFrequency,
-			uint16_t * pdefaultSpiFrequency
+			uint16_t * pvalid_samples_nb,
+			uint32_t * pactualSpiFrequency,
+			uint32_t * pdefaultSpiFrequency
 			);
 
-int platform_chunck_transfer_and_get_samples(void * client, int16_t * samples);
+int platform_get_samples(void * client, int16_t ** psamples);
+int platform_get_samples_timestamp(void *client, int16_t * samples, uint64_t * ptimestamp);
+void platform_get_capture_stats(void *client,
+			uint16_t * pqueue_size,
+			uint16_t * pqueue_depth,
+			uint16_t * pqueue_high_water,
+			uint32_t * poverruns,
+			uint32_t * pstalls
+			);
+void platform_cancel_get_samples(void * client);
+int platform_set_thread_cpu(int cpu);
 int platform_spi_stop(void *client);
 int platform_start_next_transfer(void *client);
 int platform_set_fft_info(void *client, uint32_t sampling_frequency);
+int platform_set_hop(void *client, uint32_t hop_ms);
+int platform_set_record(void *client, int record);
 int platform_get_samples_nb(uint16_t * psamples_nb);
 
 #ifdef __cplusplus
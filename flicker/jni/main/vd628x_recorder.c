@@ -0,0 +1,448 @@
+/********************************************************************************
+Copyright (c) 2025, STMicroelectronics - All Rights Reserved
+This file is licensed under open source license ST SLA0103
+********************************************************************************/
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <sys/uio.h>
+
+#include "vd628x_recorder.h"
+
+#define LOG printf
+
+#define MIN(a,b) ((a)<(b)?(a):(b))
+
+// size of the fifo between the capture thread and the recorder thread, a power of 2
+#ifndef RECORDER_FIFO_BYTES
+#define RECORDER_FIFO_BYTES (1024*1024)
+#endif
+#if (RECORDER_FIFO_BYTES & (RECORDER_FIFO_BYTES - 1)) != 0
+#error "RECORDER_FIFO_BYTES must be a power of 2"
+#endif
+
+// chunks per block of the file, and blocks per index
+#define RECORDER_BLOCK_CHUNKS 128
+#define RECORDER_INDEX_ENTRIES 64
+// chunks are in the file at most this time after their capture
+#define RECORDER_FLUSH_MS 1000
+
+//
+// fifo_record
+// header of the chunks put in the fifo, followed by their times and samples
+//
+struct fifo_record {
+	uint32_t sampling_frequency;
+	uint32_t spi_frequency;
+	uint16_t chunk_samples;
+	uint16_t chunks_nb;
+	uint32_t dropped;
+};
+
+struct vd628x_recorder {
+	// fifo : tail is written by the producer only, head by the recorder thread only
+	uint8_t * fifo;
+	atomic_uint head;
+	atomic_uint tail;
+	sem_t fifo_sem;               // posted for each record put in the fifo
+	uint32_t dropped;             // producer only : dropped since the last record
+	atomic_uint dropped_total;
+	// recorder thread only : chunks block being filled
+	struct vd628x_record_chunks block;
+	uint64_t times[RECORDER_BLOCK_CHUNKS];
+	int16_t * samples;
+	uint16_t samples_chunk_max;   // chunk samples the samples buffer is allocated for
+	// recorder thread only : file
+	int fd;
+	int error;
+	uint64_t offset;
+	uint64_t last_index;
+	uint64_t chunks_total;
+	struct vd628x_record_index_entry entries[RECORDER_INDEX_ENTRIES];
+	uint32_t entries_nb;
+	char path[256];
+	// recorder thread
+	pthread_t thread;
+	atomic_int stop;
+};
+
+static const uint8_t padding[8];
+
+
+//
+// fifo_write
+//
+static void fifo_write(struct vd628x_recorder * rec, uint32_t pos, const void * src, uint32_t size)
+{
+	uint32_t off = pos & (RECORDER_FIFO_BYTES - 1);
+	uint32_t n = MIN(size, RECORDER_FIFO_BYTES - off);
+
+	memcpy(&rec->fifo[off], src, n);
+	memcpy(rec->fifo, (const uint8_t *)src + n, size - n);
+}
+
+//
+// fifo_read
+//
+static void fifo_read(struct vd628x_recorder * rec, uint32_t pos, void * dst, uint32_t size)
+{
+	uint32_t off = pos & (RECORDER_FIFO_BYTES - 1);
+	uint32_t n = MIN(size, RECORDER_FIFO_BYTES - off);
+
+	memcpy(dst, &rec->fifo[off], n);
+	memcpy((uint8_t *)dst + n, rec->fifo, size - n);
+}
+
+//
+// write_blocks
+// writes iov_nb buffers at the end of the file. after an error nothing is written anymore
+//
+static void write_blocks(struct vd628x_recorder * rec, struct iovec * iov, int iov_nb)
+{
+	ssize_t ret;
+
+	while ((iov_nb > 0) && !rec->error) {
+		ret = writev(rec->fd, iov, iov_nb);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			LOG("FLICKER : Error. Could not write %s (errno %d), recording stopped\n", rec->path, errno);
+			rec->error = 1;
+			return;
+		}
+		rec->offset += ret;
+		// partial write : the rest of the buffers is written again
+		while ((iov_nb > 0) && ((size_t)ret >= iov->iov_len)) {
+			ret -= iov->iov_len;
+			iov++;
+			iov_nb--;
+		}
+		if (iov_nb > 0) {
+			iov->iov_base = (uint8_t *)iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
+}
+
+//
+// write_index
+// index of the chunks blocks written since the previous index
+//
+static void write_index(struct vd628x_recorder * rec)
+{
+	struct vd628x_record_index index;
+	struct iovec iov[2];
+	uint64_t offset = rec->offset;
+
+	if (rec->entries_nb == 0)
+		return;
+
+	index.block.type = VD628X_RECORD_INDEX;
+	index.block.size = sizeof(index) + rec->entries_nb * sizeof(struct vd628x_record_index_entry);
+	index.entries_nb = rec->entries_nb;
+	index.reserved = 0;
+	index.previous = rec->last_index;
+
+	iov[0].iov_base = &index;
+	iov[0].iov_len = sizeof(index);
+	iov[1].iov_base = rec->entries;
+	iov[1].iov_len = rec->entries_nb * sizeof(struct vd628x_record_index_entry);
+	write_blocks(rec, iov, 2);
+
+	rec->last_index = offset;
+	rec->entries_nb = 0;
+}
+
+//
+// flush_block
+// writes the chunks block being filled and indexes it
+//
+static void flush_block(struct vd628x_recorder * rec)
+{
+	struct iovec iov[4];
+	uint32_t samples_size;
+
+	if (rec->block.chunks_nb == 0)
+		return;
+
+	samples_size = rec->block.chunks_nb * rec->block.chunk_samples * sizeof(int16_t);
+	rec->block.block.type = VD628X_RECORD_CHUNKS;
+	rec->block.block.size = sizeof(rec->block) + rec->block.chunks_nb * sizeof(uint64_t) +
+		((samples_size + 7) & ~7);
+
+	rec->entries[rec->entries_nb].offset = rec->offset;
+	rec->entries[rec->entries_nb].time = rec->times[0];
+	rec->entries_nb++;
+
+	iov[0].iov_base = &rec->block;
+	iov[0].iov_len = sizeof(rec->block);
+	iov[1].iov_base = rec->times;
+	iov[1].iov_len = rec->block.chunks_nb * sizeof(uint64_t);
+	iov[2].iov_base = rec->samples;
+	iov[2].iov_len = samples_size;
+	iov[3].iov_base = (void *)padding;
+	iov[3].iov_len = ((samples_size + 7) & ~7) - samples_size;
+	write_blocks(rec, iov, 4);
+
+	rec->chunks_total += rec->block.chunks_nb;
+	rec->block.chunks_nb = 0;
+	rec->block.dropped = 0;
+
+	if (rec->entries_nb == RECORDER_INDEX_ENTRIES)
+		write_index(rec);
+}
+
+//
+// drain_fifo
+// moves the chunks of the fifo to blocks. a block is written once full, when the
+// sampling frequency changes or when chunks were dropped before the next ones
+// the spi frequency of a block is the latest estimate
+//
+static void drain_fifo(struct vd628x_recorder * rec)
+{
+	struct fifo_record r;
+	uint32_t head = atomic_load_explicit(&rec->head, memory_order_relaxed);
+	uint32_t tail = atomic_load_explicit(&rec->tail, memory_order_acquire);
+	uint32_t samples_size;
+	int16_t * samples;
+	uint16_t i;
+
+	while (head != tail) {
+		fifo_read(rec, head, &r, sizeof(r));
+		head += sizeof(r);
+		samples_size = r.chunk_samples * sizeof(int16_t);
+
+		if ((r.sampling_frequency != rec->block.sampling_frequency) ||
+			(r.chunk_samples != rec->block.chunk_samples) ||
+			(r.dropped != 0))
+			flush_block(rec);
+
+		if (r.chunk_samples > rec->samples_chunk_max) {
+			samples = (int16_t *)realloc(rec->samples, RECORDER_BLOCK_CHUNKS * samples_size);
+			if (samples == NULL) {
+				LOG("FLICKER : Error. Could not allocate the recorder block, %d chunks dropped\n", r.chunks_nb);
+				head += r.chunks_nb * (sizeof(uint64_t) + samples_size);
+				atomic_store_explicit(&rec->head, head, memory_order_release);
+				continue;
+			}
+			rec->samples = samples;
+			rec->samples_chunk_max = r.chunk_samples;
+		}
+
+		rec->block.sampling_frequency = r.sampling_frequency;
+		rec->block.spi_frequency = r.spi_frequency;
+		rec->block.chunk_samples = r.chunk_samples;
+		rec->block.dropped += r.dropped;
+
+		// times then samples of the chunks
+		for (i = 0; i < r.chunks_nb; i++) {
+			if (rec->block.chunks_nb == RECORDER_BLOCK_CHUNKS)
+				flush_block(rec);
+			fifo_read(rec, head + i * sizeof(uint64_t), &rec->times[rec->block.chunks_nb], sizeof(uint64_t));
+			fifo_read(rec, head + r.chunks_nb * sizeof(uint64_t) + i * samples_size,
+				&rec->samples[rec->block.chunks_nb * r.chunk_samples], samples_size);
+			rec->block.chunks_nb++;
+		}
+		head += r.chunks_nb * (sizeof(uint64_t) + samples_size);
+
+		// the space of the record is given back to the producer
+		atomic_store_explicit(&rec->head, head, memory_order_release);
+	}
+}
+
+//
+// recorder_routine
+// recorder thread : chunks go from the fifo to the file until vd628x_recorder_stop
+// then the last chunks, the index and the end of the file are written
+//
+static void *recorder_routine(void * arg)
+{
+	struct vd628x_recorder * rec = arg;
+	struct vd628x_record_end end;
+	struct iovec iov;
+	struct timespec t;
+	uint64_t now;
+	int stop;
+
+	do {
+		// read first : the chunks put before the stop are drained below
+		stop = atomic_load(&rec->stop);
+		drain_fifo(rec);
+
+		// the chunks are not kept longer than RECORDER_FLUSH_MS in memory
+		clock_gettime(CLOCK_MONOTONIC, &t);
+		now = (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+		if (rec->block.chunks_nb && (now - rec->times[0] >= (uint64_t)RECORDER_FLUSH_MS * 1000000))
+			flush_block(rec);
+
+		if (!stop) {
+			clock_gettime(CLOCK_REALTIME, &t);
+			t.tv_sec += RECORDER_FLUSH_MS / 1000;
+			t.tv_nsec += (RECORDER_FLUSH_MS % 1000) * 1000000;
+			if (t.tv_nsec >= 1000000000) {
+				t.tv_sec++;
+				t.tv_nsec -= 1000000000;
+			}
+			sem_timedwait(&rec->fifo_sem, &t);
+		}
+	} while (!stop);
+
+	flush_block(rec);
+	write_index(rec);
+
+	end.block.type = VD628X_RECORD_END;
+	end.block.size = sizeof(end);
+	end.index = rec->last_index;
+	end.dropped = atomic_load(&rec->dropped_total);
+	end.reserved = 0;
+	iov.iov_base = &end;
+	iov.iov_len = sizeof(end);
+	write_blocks(rec, &iov, 1);
+
+	close(rec->fd);
+	LOG("FLICKER : recording %s closed. %" PRIu64 " chunks recorded, %d chunks dropped\n",
+		rec->path, rec->chunks_total, atomic_load(&rec->dropped_total));
+
+	return NULL;
+}
+
+//
+// vd628x_recorder_open
+// creates the recording file path and starts the recorder thread
+// an existing file is not overwritten
+//
+struct vd628x_recorder * vd628x_recorder_open(const char * path)
+{
+	struct vd628x_recorder * rec;
+	struct vd628x_record_header header;
+	struct iovec iov;
+
+	rec = (struct vd628x_recorder *)calloc(1, sizeof(struct vd628x_recorder));
+	if (rec == NULL)
+		return NULL;
+
+	// touched now so that the capture thread takes no page fault
+	rec->fifo = (uint8_t *)malloc(RECORDER_FIFO_BYTES);
+	if (rec->fifo == NULL)
+		goto error_fifo;
+	memset(rec->fifo, 0, RECORDER_FIFO_BYTES);
+
+	snprintf(rec->path, sizeof(rec->path), "%s", path);
+	rec->fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_APPEND, 0644);
+	if (rec->fd < 0) {
+		LOG("FLICKER : Error. Could not create %s (errno %d)\n", path, errno);
+		goto error_open;
+	}
+
+	memcpy(header.magic, VD628X_RECORD_MAGIC, sizeof(header.magic));
+	header.version = VD628X_RECORD_VERSION;
+	header.size = sizeof(header);
+	iov.iov_base = &header;
+	iov.iov_len = sizeof(header);
+	write_blocks(rec, &iov, 1);
+	if (rec->error)
+		goto error_write;
+
+	atomic_init(&rec->head, 0);
+	atomic_init(&rec->tail, 0);
+	atomic_init(&rec->dropped_total, 0);
+	atomic_init(&rec->stop, 0);
+	sem_init(&rec->fifo_sem, 0, 0);
+
+	if (pthread_create(&rec->thread, NULL, recorder_routine, rec)) {
+		LOG("FLICKER : Error. recorder thread create failed\n");
+		sem_destroy(&rec->fifo_sem);
+		goto error_write;
+	}
+
+	LOG("FLICKER : recording to %s\n", path);
+
+	return rec;
+
+error_write:
+	close(rec->fd);
+	unlink(path);
+error_open:
+	free(rec->fifo);
+error_fifo:
+	free(rec);
+	return NULL;
+}
+
+//
+// vd628x_recorder_put
+// hands chunks_nb chunks and their end times over to the recorder thread
+// a single producer thread calls it. returns -1 if the chunks were dropped
+// because the fifo is full
+//
+int vd628x_recorder_put(struct vd628x_recorder * rec,
+		const int16_t * samples,
+		const uint64_t * times,
+		uint16_t chunks_nb,
+		uint16_t chunk_samples,
+		uint32_t sampling_frequency,
+		uint32_t spi_frequency)
+{
+	struct fifo_record r;
+	uint32_t tail = atomic_load_explicit(&rec->tail, memory_order_relaxed);
+	uint32_t head = atomic_load_explicit(&rec->head, memory_order_acquire);
+	uint32_t times_size = chunks_nb * sizeof(uint64_t);
+	uint32_t samples_size = chunks_nb * chunk_samples * sizeof(int16_t);
+
+	if (sizeof(r) + times_size + samples_size > RECORDER_FIFO_BYTES - (tail - head)) {
+		rec->dropped += chunks_nb;
+		atomic_fetch_add(&rec->dropped_total, chunks_nb);
+		return -1;
+	}
+
+	r.sampling_frequency = sampling_frequency;
+	r.spi_frequency = spi_frequency;
+	r.chunk_samples = chunk_samples;
+	r.chunks_nb = chunks_nb;
+	r.dropped = rec->dropped;
+	rec->dropped = 0;
+
+	fifo_write(rec, tail, &r, sizeof(r));
+	fifo_write(rec, tail + sizeof(r), times, times_size);
+	fifo_write(rec, tail + sizeof(r) + times_size, samples, samples_size);
+	atomic_store_explicit(&rec->tail, tail + sizeof(r) + times_size + samples_size, memory_order_release);
+	sem_post(&rec->fifo_sem);
+
+	return 0;
+}
+
+//
+// vd628x_recorder_stop
+// no chunk is put anymore : the recorder thread writes the chunks of the fifo and
+// closes the file. does not wait for it
+//
+void vd628x_recorder_stop(struct vd628x_recorder * rec)
+{
+	atomic_store(&rec->stop, 1);
+	sem_post(&rec->fifo_sem);
+}
+
+//
+// vd628x_recorder_close
+// stops the recorder if needed, waits for the file to be closed and frees the recorder
+//
+void vd628x_recorder_close(struct vd628x_recorder * rec)
+{
+	void * retval;
+
+	vd628x_recorder_stop(rec);
+	pthread_join(rec->thread, &retval);
+
+	sem_destroy(&rec->fifo_sem);
+	free(rec->samples);
+	free(rec->fifo);
+	free(rec);
+}
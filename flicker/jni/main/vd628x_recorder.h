@@ -0,0 +1,96 @@
+/********************************************************************************
+Copyright (c) 2025, STMicroelectronics - All Rights Reserved
+This file is licensed under open source license ST SLA0103
+********************************************************************************/
+#ifndef __VD628X_RECORDER__
+#define __VD628X_RECORDER__ 1
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// recording file : little endian, append only, blocks aligned on 8 bytes
+// a vd628x_record_header, then blocks starting with a vd628x_record_block
+// - VD628X_RECORD_CHUNKS : a vd628x_record_chunks, the end time of each chunk in
+//   CLOCK_MONOTONIC ns (uint64_t), then the int16_t samples of the chunks
+// - VD628X_RECORD_INDEX : a vd628x_record_index, then one vd628x_record_index_entry
+//   per chunks block written since the previous index
+// - VD628X_RECORD_END : last block of a file closed properly, locates the last index
+// blocks of an unknown type are skipped with their size. a file that was not closed
+// properly is read block after block
+//
+#define VD628X_RECORD_MAGIC "VD628XRC"
+#define VD628X_RECORD_VERSION 1
+
+#define VD628X_RECORD_TAG(a, b, c, d) \
+	((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+#define VD628X_RECORD_CHUNKS VD628X_RECORD_TAG('C', 'H', 'N', 'K')
+#define VD628X_RECORD_INDEX  VD628X_RECORD_TAG('I', 'N', 'D', 'X')
+#define VD628X_RECORD_END    VD628X_RECORD_TAG('E', 'N', 'D', ' ')
+
+struct vd628x_record_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t size;  // of this header
+};
+
+struct vd628x_record_block {
+	uint32_t type;
+	uint32_t size;  // of the block, this header and the padding included
+};
+
+struct vd628x_record_chunks {
+	struct vd628x_record_block block;
+	uint32_t sampling_frequency;  // in Hz
+	uint32_t spi_frequency;       // measured spi clock in Hz, when the last chunk was captured
+	uint16_t chunk_samples;
+	uint16_t chunks_nb;
+	uint32_t dropped;             // chunks not recorded just before the first one
+};
+
+struct vd628x_record_index_entry {
+	uint64_t offset;  // of a chunks block, from the start of the file
+	uint64_t time;    // end time of its first chunk
+};
+
+struct vd628x_record_index {
+	struct vd628x_record_block block;
+	uint32_t entries_nb;
+	uint32_t reserved;
+	uint64_t previous;  // offset of the previous index, 0 for the first one
+};
+
+struct vd628x_record_end {
+	struct vd628x_record_block block;
+	uint64_t index;    // offset of the last index, 0 if none
+	uint32_t dropped;  // chunks not recorded, the ones after the last block included
+	uint32_t reserved;
+};
+
+//
+// vd628x_recorder
+// writes chunks to a recording file from its own thread. chunks are handed over
+// through a wait-free fifo : vd628x_recorder_put never waits for the file, chunks
+// are dropped when the fifo is full
+//
+struct vd628x_recorder;
+
+struct vd628x_recorder * vd628x_recorder_open(const char * path);
+int vd628x_recorder_put(struct vd628x_recorder * rec,
+		const int16_t * samples,
+		const uint64_t * times,
+		uint16_t chunks_nb,
+		uint16_t chunk_samples,
+		uint32_t sampling_frequency,
+		uint32_t spi_frequency);
+void vd628x_recorder_stop(struct vd628x_recorder * rec);
+void vd628x_recorder_close(struct vd628x_recorder * rec);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
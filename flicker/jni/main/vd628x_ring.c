@@ -0,0 +1,173 @@
+/********************************************************************************
+Copyright (c) 2025, STMicroelectronics - All Rights Reserved
+This file is licensed under open source license ST SLA0103
+********************************************************************************/
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "vd628x_ring.h"
+
+#define LOG printf
+
+#define MIN(a,b) ((a)<(b)?(a):(b))
+
+// producer and consumer are shared with another context : the chunk
+// content is written before producer moves, and read before consumer moves
+#define RING_LOAD(field) __atomic_load_n(&(field), __ATOMIC_ACQUIRE)
+#define RING_STORE(field, value) __atomic_store_n(&(field), (value), __ATOMIC_RELEASE)
+
+
+//
+// vd628x_ring_map
+// maps the ring of fd and checks its header
+//
+int vd628x_ring_map(struct vd628x_ring * ring, int fd, size_t map_size)
+{
+	struct vd628x_ring_header * header;
+	void * map;
+
+	map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		LOG("Error. Could not map the sample ring\n");
+		return -1;
+	}
+
+	header = (struct vd628x_ring_header *)map;
+	if ((header->magic != VD628x_RING_MAGIC) || (header->chunks_nb == 0) ||
+		(header->data_offset < sizeof(struct vd628x_ring_header)) ||
+		(header->data_offset + (size_t)header->chunks_nb * header->chunk_samples * sizeof(int16_t) > map_size)) {
+		LOG("Error. Wrong sample ring header\n");
+		munmap(map, map_size);
+		return -1;
+	}
+
+	ring->header = header;
+	ring->chunks = (int16_t *)((char *)map + header->data_offset);
+	ring->map_size = map_size;
+
+	return 0;
+}
+
+//
+// vd628x_ring_unmap
+//
+void vd628x_ring_unmap(struct vd628x_ring * ring)
+{
+	if (ring->header == NULL)
+		return;
+
+	munmap(ring->header, ring->map_size);
+	ring->header = NULL;
+	ring->chunks = NULL;
+}
+
+//
+// vd628x_ring_available
+// number of chunks written after the chunk at position
+//
+uint32_t vd628x_ring_available(struct vd628x_ring * ring, uint32_t position)
+{
+	return RING_LOAD(ring->header->producer) - position;
+}
+
+//
+// vd628x_ring_copy
+// copies chunks_nb chunks from position, in time order
+//
+void vd628x_ring_copy(struct vd628x_ring * ring, int16_t * samples, uint32_t position, uint32_t chunks_nb)
+{
+	uint32_t chunk_samples = ring->header->chunk_samples;
+	uint32_t first = position % ring->header->chunks_nb;
+	uint32_t n = MIN(chunks_nb, ring->header->chunks_nb - first);
+
+	memcpy(samples, &ring->chunks[first * chunk_samples], n * chunk_samples * sizeof(int16_t));
+	// the end of the ring is reached : the next chunks are at the start
+	memcpy(&samples[n * chunk_samples], ring->chunks, (chunks_nb - n) * chunk_samples * sizeof(int16_t));
+}
+
+//
+// vd628x_ring_release
+// the chunks before position can be written again by the producer
+//
+void vd628x_ring_release(struct vd628x_ring * ring, uint32_t position)
+{
+	RING_STORE(ring->header->consumer, position);
+}
+
+//
+// vd628x_ring_consumer
+// position of the first chunk not yet released
+//
+uint32_t vd628x_ring_consumer(struct vd628x_ring * ring)
+{
+	return RING_LOAD(ring->header->consumer);
+}
+
+//
+// vd628x_ring_overruns
+// number of chunks dropped by the producer because the ring was full
+//
+uint32_t vd628x_ring_overruns(struct vd628x_ring * ring)
+{
+	return RING_LOAD(ring->header->overruns);
+}
+
+//
+// vd628x_ring_create
+// creates a ring in a shared memory file, for a stand-in producer of the vd628x_spi driver
+// the consumer maps the file as it maps the device
+//
+int vd628x_ring_create(struct vd628x_ring * ring, const char * path, uint32_t chunks_nb, uint32_t chunk_samples)
+{
+	struct vd628x_ring_header header;
+	uint32_t data_offset = (uint32_t)sysconf(_SC_PAGESIZE);
+	size_t map_size = data_offset + (size_t)chunks_nb * chunk_samples * sizeof(int16_t);
+	int fd, err;
+
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0) {
+		LOG("Error. Could not create %s\n", path);
+		return -1;
+	}
+
+	memset(&header, 0, sizeof(header));
+	header.magic = VD628x_RING_MAGIC;
+	header.chunks_nb = chunks_nb;
+	header.chunk_samples = chunk_samples;
+	header.data_offset = data_offset;
+
+	err = ftruncate(fd, map_size);
+	if (!err && (pwrite(fd, &header, sizeof(header), 0) != sizeof(header)))
+		err = -1;
+	if (!err)
+		err = vd628x_ring_map(ring, fd, map_size);
+	// the mapping stays valid once the file is closed
+	close(fd);
+
+	return err;
+}
+
+//
+// vd628x_ring_produce
+// writes one chunk of samples if the consumer released room for it
+// returns -1 if the ring is full : the chunk is dropped and counted in overruns
+//
+int vd628x_ring_produce(struct vd628x_ring * ring, const int16_t * samples)
+{
+	struct vd628x_ring_header * header = ring->header;
+	uint32_t producer = header->producer;
+
+	if (producer - RING_LOAD(header->consumer) >= header->chunks_nb) {
+		RING_STORE(header->overruns, header->overruns + 1);
+		return -1;
+	}
+
+	memcpy(&ring->chunks[(producer % header->chunks_nb) * header->chunk_samples], samples,
+		header->chunk_samples * sizeof(int16_t));
+	RING_STORE(header->producer, producer + 1);
+
+	return 0;
+}
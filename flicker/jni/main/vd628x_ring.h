@@ -0,0 +1,45 @@
+/********************************************************************************
+Copyright (c) 2025, STMicroelectronics - All Rights Reserved
+This file is licensed under open source license ST SLA0103
+********************************************************************************/
+#ifndef __VD628X_RING__
+#define __VD628X_RING__ 1
+
+#include <stdint.h>
+#include <stddef.h>
+#include <linux/types.h>
+#include "vd628x_adapter_ioctl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// vd628x_ring
+// sample ring shared with a producer : the vd628x_spi driver, or a stand-in
+// producer writing in a shared memory file
+//
+struct vd628x_ring {
+	struct vd628x_ring_header * header;
+	int16_t * chunks;
+	size_t map_size;
+};
+
+// consumer side
+int vd628x_ring_map(struct vd628x_ring * ring, int fd, size_t map_size);
+void vd628x_ring_unmap(struct vd628x_ring * ring);
+uint32_t vd628x_ring_available(struct vd628x_ring * ring, uint32_t position);
+void vd628x_ring_copy(struct vd628x_ring * ring, int16_t * samples, uint32_t position, uint32_t chunks_nb);
+void vd628x_ring_release(struct vd628x_ring * ring, uint32_t position);
+uint32_t vd628x_ring_consumer(struct vd628x_ring * ring);
+uint32_t vd628x_ring_overruns(struct vd628x_ring * ring);
+
+// stand-in producer side
+int vd628x_ring_create(struct vd628x_ring * ring, const char * path, uint32_t chunks_nb, uint32_t chunk_samples);
+int vd628x_ring_produce(struct vd628x_ring * ring, const int16_t * samples);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
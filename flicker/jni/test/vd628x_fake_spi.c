@@ -0,0 +1,329 @@
+/********************************************************************************
+Copyright (c) 2025, STMicroelectronics - All Rights Reserved
+This file is licensed under open source license ST SLA0103
+********************************************************************************/
+//
+// stand-in of the vd628x_spi driver ioctls, to run the kernel backend on a linux host
+// open and ioctl of the device are answered here : chunks are captured at the pace of
+// the sampling frequency, and the ones captured meanwhile are transferred by
+// VD628x_IOCTL_GET_CHUNKS_SAMPLES, or one by one by VD628x_IOCTL_GET_CHUNK_SAMPLES
+// the reads of vd628x_backend_kernel are checked : samples count from 0
+// -1 the fake driver rejects VD628x_IOCTL_GET_CHUNKS_SAMPLES, as an older one does
+// -r the device can't be opened for writing : it must be opened read only, and no ring
+// is asked for
+// -l the reader waits latency us after each transfer, so that chunks pile up
+//
+// host build :
+// gcc -Imain -Iioctl test/vd628x_fake_spi.c main/vd628x_backend_kernel.c main/vd628x_ring.c -o vd628x_fake_spi -lpthread
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+
+#include "vd628x_backend.h"
+
+#define LOG printf
+
+#define FAKE_DEVICE "/dev/vd628x_spi"
+#define FAKE_CHUNK_SIZE 4096
+#define FAKE_SPI_MAX_FREQUENCY (4 * 1024 * 1024)
+#define DEFAULT_SAMPLING_FREQUENCY 2048
+#define DEFAULT_CHUNK_SAMPLES 16
+#define DEFAULT_LATENCY_US 20000
+#define TEST_PATTERN_MASK 0x3FFF
+#define FAKE_TRANSFER_CHUNKS_MAX 64
+
+//
+// fake_spi
+// the eventfd of the device counts the chunks captured and not transferred yet :
+// poll reports POLLIN while there is one
+//
+static struct fake_spi {
+	int fd;
+	int single;                 // VD628x_IOCTL_GET_CHUNKS_SAMPLES rejected
+	int read_only;              // open for writing rejected
+	uint32_t ring_requests;     // VD628x_IOCTL_SET_RING on a read only device
+	uint32_t sampling_frequency;
+	uint16_t chunk_samples;
+	uint32_t sample;            // next sample of the pattern
+	pthread_t capture_thread;
+	volatile int capture_runs;
+	// transfers of n chunks
+	uint32_t transfers[FAKE_TRANSFER_CHUNKS_MAX + 1];
+} fake = { .fd = -1 };
+
+//
+// fake_capture
+// one chunk captured every chunk_samples samples
+//
+static void *fake_capture(void * arg)
+{
+	struct timespec next;
+	uint64_t period_ns = (uint64_t)fake.chunk_samples * 1000000000 / fake.sampling_frequency;
+	uint64_t one = 1;
+
+	(void)arg;
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while (fake.capture_runs) {
+		next.tv_nsec += period_ns;
+		while (next.tv_nsec >= 1000000000) {
+			next.tv_sec++;
+			next.tv_nsec -= 1000000000;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+		if (write(fake.fd, &one, sizeof(one)) != sizeof(one))
+			break;
+	}
+
+	return NULL;
+}
+
+//
+// fake_transfer
+// up to chunks_nb of the chunks captured are written to samples. -1 with EAGAIN if none
+//
+static int fake_transfer(int16_t * samples, uint32_t chunks_nb)
+{
+	uint64_t captured, rest;
+	uint32_t n, s;
+
+	if (read(fake.fd, &captured, sizeof(captured)) != sizeof(captured)) {
+		errno = EAGAIN;
+		return -1;
+	}
+
+	n = (captured < chunks_nb) ? (uint32_t)captured : chunks_nb;
+	for (s = 0; s < n * fake.chunk_samples; s++, fake.sample++)
+		samples[s] = (int16_t)(fake.sample & TEST_PATTERN_MASK);
+
+	// the chunks not transferred stay captured
+	rest = captured - n;
+	if (rest && (write(fake.fd, &rest, sizeof(rest)) != sizeof(rest)))
+		return -1;
+
+	fake.transfers[(n <= FAKE_TRANSFER_CHUNKS_MAX) ? n : 0]++;
+
+	return (int)n;
+}
+
+int open(const char * path, int flags, ...)
+{
+	va_list ap;
+	mode_t mode;
+
+	va_start(ap, flags);
+	mode = va_arg(ap, mode_t);
+	va_end(ap);
+
+	if (strcmp(path, FAKE_DEVICE))
+		return openat(AT_FDCWD, path, flags, mode);
+
+	if (fake.read_only && ((flags & O_ACCMODE) != O_RDONLY)) {
+		errno = EACCES;
+		return -1;
+	}
+	fake.fd = eventfd(0, EFD_CLOEXEC);
+	return fake.fd;
+}
+
+int ioctl(int fd, unsigned long request, ...)
+{
+	va_list ap;
+	void * arg;
+	int n;
+
+	va_start(ap, request);
+	arg = va_arg(ap, void *);
+	va_end(ap);
+
+	if (fd != fake.fd) {
+		errno = ENOTTY;
+		return -1;
+	}
+
+	if (request == VD628x_IOCTL_GET_SPI_INFO) {
+		struct vd628x_spi_info * info = arg;
+
+		info->chunk_size = FAKE_CHUNK_SIZE;
+		info->spi_max_frequency = FAKE_SPI_MAX_FREQUENCY;
+		return 0;
+	}
+	else if (request == VD628x_IOCTL_SET_SPI_PARAMS) {
+		const struct vd628x_spi_params * params = arg;
+
+		if (params->samples_nb_per_chunk != fake.chunk_samples) {
+			errno = EINVAL;
+			return -1;
+		}
+		if (!fake.capture_runs) {
+			fake.capture_runs = 1;
+			if (pthread_create(&fake.capture_thread, NULL, fake_capture, NULL)) {
+				fake.capture_runs = 0;
+				return -1;
+			}
+		}
+		return 0;
+	}
+	else if (request == VD628x_IOCTL_GET_CHUNK_SAMPLES) {
+		return (fake_transfer((int16_t *)arg, 1) < 0) ? -1 : 0;
+	}
+	else if ((request == VD628x_IOCTL_GET_CHUNKS_SAMPLES) && !fake.single) {
+		struct vd628x_chunks_samples * chunks = arg;
+
+		if (chunks->chunks_nb == 0)
+			return 0;
+		n = fake_transfer((int16_t *)(uintptr_t)chunks->samples, chunks->chunks_nb);
+		if (n < 0)
+			return -1;
+		chunks->chunks_nb = n;
+		return 0;
+	}
+
+	else if ((request == VD628x_IOCTL_SET_RING) && fake.read_only)
+		fake.ring_requests++;
+
+	// no ring : VD628x_IOCTL_SET_RING and the unknown requests
+	errno = ENOTTY;
+	return -1;
+}
+
+static void usage(const char * name)
+{
+	LOG("usage : %s [-1] [-r] [-s sampling frequency] [-n samples per chunk] [-l latency us] [-d seconds]\n", name);
+	LOG("        -1 no VD628x_IOCTL_GET_CHUNKS_SAMPLES : one chunk per transfer\n");
+	LOG("        -r read only device : no mapped ring\n");
+}
+
+//
+// run
+// reads the chunks through vd628x_backend_kernel for duration seconds and checks them
+//
+static int run(uint32_t latency_us, int duration)
+{
+	const struct vd628x_backend * backend = &vd628x_backend_kernel;
+	struct vd628x_backend_info info;
+	struct vd628x_spi_params params;
+	struct vd628x_ring ring;
+	struct pollfd pfd;
+	void * dev;
+	int16_t * samples;
+	int16_t expected = 0;
+	uint32_t chunks = 0, errors = 0, s, n;
+	time_t end = time(NULL) + duration;
+	int chunks_nb;
+
+	dev = backend->open(FAKE_DEVICE, &info);
+	if (dev == NULL)
+		return -1;
+	if (info.batch_chunks > FAKE_TRANSFER_CHUNKS_MAX) {
+		LOG("Error. %d chunks per transfer, the fake driver counts up to %d\n", info.batch_chunks, FAKE_TRANSFER_CHUNKS_MAX);
+		backend->close(dev);
+		return -1;
+	}
+
+	params.speed_hz = FAKE_SPI_MAX_FREQUENCY;
+	params.samples_nb_per_chunk = fake.chunk_samples;
+	params.pdm_data_sample_width_in_bytes = 2;
+	samples = (int16_t *)malloc(info.batch_chunks * fake.chunk_samples * sizeof(int16_t));
+	if ((samples == NULL) || backend->configure(dev, &params)) {
+		free(samples);
+		backend->close(dev);
+		return -1;
+	}
+
+	// the fake driver has no ring : chunks are read by read_chunks, as platform does then
+	if (backend->map_ring(dev, 2 * fake.sampling_frequency / fake.chunk_samples, &ring) == 0) {
+		LOG("Error. Ring mapped, the fake driver has none\n");
+		backend->unmap_ring(dev, &ring);
+		errors++;
+	}
+
+	pfd.fd = backend->poll_fd(dev);
+	pfd.events = POLLIN;
+	while (time(NULL) < end) {
+		if (poll(&pfd, 1, 1000) <= 0) {
+			LOG("Error. No chunk for 1 second\n");
+			errors++;
+			break;
+		}
+		chunks_nb = backend->read_chunks(dev, samples, info.batch_chunks);
+		if (chunks_nb < 0) {
+			LOG("Error. Transfer failed\n");
+			errors++;
+			break;
+		}
+
+		for (s = 0; s < (uint32_t)chunks_nb * fake.chunk_samples; s++) {
+			if (samples[s] != expected)
+				errors++;
+			expected = (int16_t)((samples[s] + 1) & TEST_PATTERN_MASK);
+		}
+		chunks += chunks_nb;
+		usleep(latency_us);
+	}
+
+	fake.capture_runs = 0;
+	pthread_join(fake.capture_thread, NULL);
+	backend->close(dev);
+	free(samples);
+
+	LOG("%d chunks read, %d samples out of sequence\n", chunks, errors);
+	for (n = 1; n <= FAKE_TRANSFER_CHUNKS_MAX; n++) {
+		if (fake.transfers[n])
+			LOG("  %5d transfers of %2d chunks\n", fake.transfers[n], n);
+	}
+	if (fake.ring_requests) {
+		LOG("Error. Ring asked for on a read only device\n");
+		errors++;
+	}
+	if ((info.batch_chunks > 1) && (chunks == fake.transfers[1])) {
+		LOG("Error. No transfer of several chunks\n");
+		errors++;
+	}
+
+	return errors ? -1 : 0;
+}
+
+int main(int argc, char * const argv[])
+{
+	uint32_t latency_us = DEFAULT_LATENCY_US;
+	int duration = 5;
+	int opt;
+
+	fake.sampling_frequency = DEFAULT_SAMPLING_FREQUENCY;
+	fake.chunk_samples = DEFAULT_CHUNK_SAMPLES;
+	while ((opt = getopt(argc, argv, "1rs:n:l:d:")) != -1) {
+		if (opt == '1')
+			fake.single = 1;
+		else if (opt == 'r')
+			fake.read_only = 1;
+		else if (opt == 's')
+			fake.sampling_frequency = atoi(optarg);
+		else if (opt == 'n')
+			fake.chunk_samples = atoi(optarg);
+		else if (opt == 'l')
+			latency_us = atoi(optarg);
+		else if (opt == 'd')
+			duration = atoi(optarg);
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if ((fake.sampling_frequency == 0) || (fake.chunk_samples == 0)) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	return run(latency_us, duration) ? 1 : 0;
+}
@@ -0,0 +1,191 @@
+/********************************************************************************
+Copyright (c) 2025, STMicroelectronics - All Rights Reserved
+This file is licensed under open source license ST SLA0103
+********************************************************************************/
+//
+// check of the real input fft against the complex one, see fft_real_execute in fft.h
+// for transforms of 2 to 4096 points, fft_real_execute and fft_real_execute_pruned run
+// on random samples and on flicker like ones, the samples after n_valid left unwritten
+// for the pruned one. their half spectrum must match the one of fft() on the same
+// samples widened into complex values, zero padded after n_valid
+// the exit status is 1 if the error exceeds CHECK_TOLERANCE for any of them
+// -v prints the error of every transform
+//
+// host build :
+// gcc -O2 -DFFT_STOCKHAM -DFFT_SIMD -Ifft test/vd628x_fft_real_check.c fft/fft-dit.c fft/fft-real.c fft/fft-band.c fft/fft-stockham.c fft/fft-simd.c -o vd628x_fft_real_check -lm
+// without -DFFT_STOCKHAM, both run on the uFFT engine
+// target build : module vd628x_fft_real_check of Android.mk, run with adb shell
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <complex.h>
+
+#include "fft.h"
+
+#define LOG printf
+
+#define CHECK_LOG2N_MAX 12
+// both paths round to about 2e-7 of the exact transform, the relative error of the
+// real input fft stated when it was introduced, so their difference can reach twice it
+#define CHECK_TOLERANCE 4e-7f
+// flicker like samples : 12 bits around mid scale, as the flicker channel
+#define FLICKER_DC 8192
+#define FLICKER_AMPLITUDE 2048
+#define FLICKER_NOISE 64
+
+static void usage(const char * name)
+{
+	LOG("usage : %s [-v]\n", name);
+	LOG("        -v prints the error of every transform\n");
+}
+
+//
+// random_fill
+// uniform samples in [-0.5, 0.5]
+//
+static void random_fill(float *x, size_t N)
+{
+	size_t i;
+
+	for (i = 0; i < N; i++)
+		x[i] = (float)rand() / RAND_MAX - 0.5f;
+}
+
+//
+// flicker_fill
+// sine of a random frequency with noise, dc removed as perform_fft does
+//
+static void flicker_fill(float *x, size_t N)
+{
+	float f = (float)rand() / RAND_MAX * N / 2;
+	float dc = 0;
+	size_t i;
+
+	for (i = 0; i < N; i++) {
+		x[i] = (int16_t)(FLICKER_DC + FLICKER_AMPLITUDE * sinf(2 * (float)M_PI * f * i / N) +
+			FLICKER_NOISE * ((float)rand() / RAND_MAX - 0.5f));
+		dc += x[i];
+	}
+	dc /= N;
+	for (i = 0; i < N; i++)
+		x[i] -= dc;
+}
+
+//
+// max_error
+// largest difference to the reference, relative to the largest reference magnitude
+//
+static float max_error(const float complex *y, const float complex *ref, size_t N)
+{
+	float err = 0, mag = 0;
+	size_t i;
+
+	for (i = 0; i < N; i++) {
+		if (cabsf(y[i] - ref[i]) > err)
+			err = cabsf(y[i] - ref[i]);
+		if (cabsf(ref[i]) > mag)
+			mag = cabsf(ref[i]);
+	}
+
+	return mag ? err / mag : err;
+}
+
+//
+// check_real
+// the first n_valid samples of x through the real fft, pruned if n_valid < N,
+// against fft() of the same samples. returns 1 if they differ
+//
+static int check_real(const float *x, size_t N, size_t n_valid, const char * samples,
+		float complex *in, float complex *out, float complex *ref_in, float complex *ref_out, int verbose)
+{
+	const struct fft_plan *plan = fft_plan_create(N);
+	size_t i;
+	float err;
+	int ret;
+
+	for (i = 0; i < N; i++)
+		ref_in[i] = (i < n_valid) ? x[i] : 0;
+	fft(ref_in, ref_out, N);
+
+	// the packed values after the valid ones are garbage : they must not be read
+	for (i = 0; i < N/2; i++)
+		in[i] = CMPLXF(1e6f, -1e6f);
+	for (i = 0; i < (n_valid + 1) / 2; i++)
+		in[i] = CMPLXF(x[2*i], (2*i + 1 < n_valid) ? x[2*i + 1] : 0);
+
+	memset(out, 0, N/2 * sizeof(float complex));
+	if (n_valid < N)
+		ret = fft_real_execute_pruned(plan, in, out, n_valid);
+	else
+		ret = fft_real_execute(plan, in, out);
+
+	err = max_error(out, ref_out, N/2);
+	if (verbose)
+		LOG("  N %5zu, %5zu valid %-7s samples : error %g\n", N, n_valid, samples, err);
+	if (ret || !(err <= CHECK_TOLERANCE)) {
+		LOG("%s samples : N %zu, %zu valid, returned %d, error %g\n", samples, N, n_valid, ret, err);
+		return 1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char * const argv[])
+{
+	float complex *in, *out, *ref_in, *ref_out;
+	float *x;
+	size_t N, n_valid, k, size = (size_t)1 << CHECK_LOG2N_MAX;
+	int log2N, verbose = 0, errors = 0, transforms = 0, opt;
+
+	while ((opt = getopt(argc, argv, "v")) != -1) {
+		if (opt == 'v')
+			verbose = 1;
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	x = (float *)malloc(size * sizeof(float));
+	in = (float complex *)malloc(size/2 * sizeof(float complex));
+	out = (float complex *)malloc(size/2 * sizeof(float complex));
+	ref_in = (float complex *)malloc(size * sizeof(float complex));
+	ref_out = (float complex *)malloc(size * sizeof(float complex));
+	if ((x == NULL) || (in == NULL) || (out == NULL) || (ref_in == NULL) || (ref_out == NULL)) {
+		LOG("Error. Out of memory\n");
+		return 1;
+	}
+
+	for (log2N = 1; log2N <= CHECK_LOG2N_MAX; log2N++) {
+		N = (size_t)1 << log2N;
+
+		// the whole window, the 0.5 and 0.25 second ramp windows of perform_fft,
+		// and odd lengths
+		size_t lengths[] = { N, N/2, N/4, N/3 | 1, 1 };
+
+		for (k = 0; k < sizeof(lengths) / sizeof(lengths[0]); k++) {
+			n_valid = lengths[k];
+			if (n_valid == 0)
+				continue;
+			random_fill(x, N);
+			errors += check_real(x, N, n_valid, "random", in, out, ref_in, ref_out, verbose);
+			flicker_fill(x, n_valid);
+			errors += check_real(x, N, n_valid, "flicker", in, out, ref_in, ref_out, verbose);
+			transforms += 2;
+		}
+	}
+
+	LOG("%d real input transforms checked, %d differ from fft()\n", transforms, errors);
+
+	fft_plan_cleanup();
+	free(x);
+	free(in);
+	free(out);
+	free(ref_in);
+	free(ref_out);
+
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,202 @@
+/********************************************************************************
+Copyright (c) 2025, STMicroelectronics - All Rights Reserved
+This file is licensed under open source license ST SLA0103
+********************************************************************************/
+//
+// check of the vector fft stage kernels against fft_stage_scalar, see fft-simd.h
+// every kernel the cpu can execute runs every stage of transforms of 2 to 8192 points,
+// the last stage in place too, on random data. the results must match the scalar ones
+// then the time of a whole transform of a 1 second window is measured for each kernel
+// -n window size for the timing, 4096 by default
+//
+// host build :
+// gcc -O2 -DFFT_SIMD -DFFT_NEON -Ifft test/vd628x_fft_simd_check.c fft/fft-simd.c fft/fft-stockham.c -o vd628x_fft_simd_check -lm
+// target build : module vd628x_fft_simd_check of Android.mk, run with adb shell
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include <complex.h>
+
+#include "fft-simd.h"
+
+#define LOG printf
+
+#define CHECK_LOG2N_MAX 13
+#define CHECK_TOLERANCE 1e-5f
+#define DEFAULT_WINDOW 4096
+#define TIMING_SECONDS 1
+
+static void usage(const char * name)
+{
+	LOG("usage : %s [-n window size]\n", name);
+}
+
+static void random_fill(float complex *x, size_t N)
+{
+	size_t i;
+
+	for (i = 0; i < N; i++)
+		x[i] = CMPLXF((float)rand() / RAND_MAX - 0.5f, (float)rand() / RAND_MAX - 0.5f);
+}
+
+static void twiddles_fill(float complex *w, size_t N)
+{
+	size_t k;
+
+	for (k = 0; k < N/2; k++)
+		w[k] = cexpf(CMPLXF(0, -2 * (float)M_PI * k / N));
+}
+
+//
+// max_error
+// largest difference to the reference, relative to the largest reference magnitude
+//
+static float max_error(const float complex *y, const float complex *ref, size_t N)
+{
+	float err = 0, mag = 0;
+	size_t i;
+
+	for (i = 0; i < N; i++) {
+		if (cabsf(y[i] - ref[i]) > err)
+			err = cabsf(y[i] - ref[i]);
+		if (cabsf(ref[i]) > mag)
+			mag = cabsf(ref[i]);
+	}
+
+	return mag ? err / mag : err;
+}
+
+//
+// check_kernel
+// every stage of every size, out of place then the last stage in place
+// returns the number of stages that differ from the scalar kernel
+//
+static int check_kernel(fft_stage_kernel kernel, const char * name,
+		float complex *x, float complex *y, float complex *ref, float complex *w)
+{
+	size_t N, s;
+	int log2N, errors = 0;
+	float err;
+
+	for (log2N = 1; log2N <= CHECK_LOG2N_MAX; log2N++) {
+		N = (size_t)1 << log2N;
+		twiddles_fill(w, N);
+		for (s = 1; s <= N/2; s <<= 1) {
+			random_fill(x, N);
+			fft_stage_scalar(x, ref, w, N, s);
+			memset(y, 0, N * sizeof(float complex));
+			kernel(x, y, w, N, s);
+			err = max_error(y, ref, N);
+			if (!(err <= CHECK_TOLERANCE)) {
+				LOG("%s : N %zu s %zu, error %g\n", name, N, s, err);
+				errors++;
+			}
+		}
+
+		// the last stage runs in place
+		random_fill(x, N);
+		fft_stage_scalar(x, ref, w, N, N/2);
+		kernel(x, x, w, N, N/2);
+		err = max_error(x, ref, N);
+		if (!(err <= CHECK_TOLERANCE)) {
+			LOG("%s : N %zu in place, error %g\n", name, N, err);
+			errors++;
+		}
+	}
+
+	return errors;
+}
+
+//
+// time_kernel
+// ns per transform of N points, all the stages run by kernel as fft_stockham_execute does
+//
+static double time_kernel(fft_stage_kernel kernel, float complex *x, float complex *y, float complex *w, size_t N)
+{
+	struct timespec start, now;
+	double elapsed;
+	size_t s;
+	long runs = 0;
+
+	twiddles_fill(w, N);
+	random_fill(x, N);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	do {
+		float complex *buffers[2] = { x, y };
+		int b = 0;
+
+		for (s = 1; s < N/2; s <<= 1, b++)
+			kernel(buffers[b&1], buffers[~b&1], w, N, s);
+		kernel(buffers[b&1], y, w, N, N/2);
+		runs++;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		elapsed = (now.tv_sec - start.tv_sec) * 1e9 + (now.tv_nsec - start.tv_nsec);
+	} while (elapsed < TIMING_SECONDS * 1e9);
+
+	return elapsed / runs;
+}
+
+int main(int argc, char * const argv[])
+{
+	fft_stage_kernel kernels[FFT_SIMD_KERNELS_MAX];
+	const char *names[FFT_SIMD_KERNELS_MAX];
+	const char *selected;
+	float complex *x, *y, *ref, *w;
+	size_t window = DEFAULT_WINDOW;
+	size_t size;
+	double scalar_ns = 0, ns;
+	int n, k, errors = 0, opt;
+
+	while ((opt = getopt(argc, argv, "n:")) != -1) {
+		if (opt == 'n')
+			window = strtoul(optarg, NULL, 0);
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if ((window < 2) || (window & (window - 1))) {
+		LOG("Error. The window size must be a power of 2\n");
+		return 1;
+	}
+
+	size = ((window > ((size_t)1 << CHECK_LOG2N_MAX)) ? window : ((size_t)1 << CHECK_LOG2N_MAX)) * sizeof(float complex);
+	x = (float complex *)malloc(size);
+	y = (float complex *)malloc(size);
+	ref = (float complex *)malloc(size);
+	w = (float complex *)malloc(size);
+	if ((x == NULL) || (y == NULL) || (ref == NULL) || (w == NULL)) {
+		LOG("Error. Out of memory\n");
+		return 1;
+	}
+
+	n = fft_simd_kernels(kernels, names, FFT_SIMD_KERNELS_MAX);
+	if (n > FFT_SIMD_KERNELS_MAX)
+		n = FFT_SIMD_KERNELS_MAX;
+	fft_simd_select(&selected);
+	LOG("%d stage kernels, %s selected\n", n, selected);
+
+	for (k = 0; k < n; k++) {
+		if (k > 0)
+			errors += check_kernel(kernels[k], names[k], x, y, ref, w);
+		ns = time_kernel(kernels[k], x, y, w, window);
+		if (k == 0)
+			scalar_ns = ns;
+		LOG("  %-6s : %9.0f ns per %zu points transform, x%.2f\n", names[k], ns, window, scalar_ns / ns);
+	}
+
+	if (errors)
+		LOG("%d stages differ from the scalar kernel\n", errors);
+
+	free(x);
+	free(y);
+	free(ref);
+	free(w);
+
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,314 @@
+/********************************************************************************
+Copyright (c) 2025, STMicroelectronics - All Rights Reserved
+This file is licensed under open source license ST SLA0103
+********************************************************************************/
+//
+// dump and check of a recording of the flicker channel, see vd628x_recorder.h
+// walks the blocks of the file and checks their sizes, the chunk times and that the
+// index and the end blocks locate the chunks blocks written before them
+// -v prints every block
+// -o writes the samples as int16, to be read again with PLATFORM_SPI_DEVICE="file:<path>"
+// the exit status is 1 if the file is malformed. a file that was not closed properly
+// is reported but is not an error
+//
+// host build :
+// gcc -Imain test/vd628x_rec_dump.c -o vd628x_rec_dump
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <inttypes.h>
+
+#include "vd628x_recorder.h"
+
+#define LOG printf
+
+struct rec_check {
+	uint8_t * data;
+	uint64_t size;
+	int verbose;
+	FILE * samples_out;
+	// chunks blocks not indexed yet, the index and end blocks are checked against them
+	struct vd628x_record_index_entry * entries;
+	uint32_t entries_nb;
+	uint32_t entries_max;
+	uint64_t last_index;
+	// totals
+	uint32_t blocks;
+	uint64_t chunks;
+	uint64_t dropped;
+	uint32_t out_of_order;
+	uint64_t last_time;
+	uint32_t errors;
+	int closed;
+};
+
+static void usage(const char * name)
+{
+	LOG("usage : %s [-v] [-o samples path] recording\n", name);
+	LOG("        -v prints every block\n");
+	LOG("        -o writes the int16 samples of the recording to samples path\n");
+}
+
+#define CHECK_ERROR(check, offset, ...) \
+	do { \
+		LOG("offset %" PRIu64 " : ", (uint64_t)(offset)); \
+		LOG(__VA_ARGS__); \
+		(check)->errors++; \
+	} while (0)
+
+//
+// read_file
+//
+static uint8_t * read_file(const char * path, uint64_t * psize)
+{
+	FILE * f;
+	uint8_t * data;
+	long size;
+
+	f = fopen(path, "rb");
+	if (f == NULL) {
+		LOG("Error. Could not open %s\n", path);
+		return NULL;
+	}
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	data = (uint8_t *)malloc(size ? size : 1);
+	if ((data == NULL) || (fread(data, 1, size, f) != (size_t)size)) {
+		LOG("Error. Could not read %s\n", path);
+		free(data);
+		fclose(f);
+		return NULL;
+	}
+	fclose(f);
+	*psize = size;
+
+	return data;
+}
+
+//
+// check_chunks
+// a chunks block : size, chunk times, and it is kept for the next index
+//
+static void check_chunks(struct rec_check * check, uint64_t offset)
+{
+	struct vd628x_record_chunks chunks;
+	const uint8_t * p = check->data + offset;
+	uint64_t samples_size, time;
+	uint32_t i;
+
+	if (((struct vd628x_record_block *)p)->size < sizeof(chunks)) {
+		CHECK_ERROR(check, offset, "chunks block of %d bytes\n", ((struct vd628x_record_block *)p)->size);
+		return;
+	}
+	memcpy(&chunks, p, sizeof(chunks));
+	samples_size = (uint64_t)chunks.chunks_nb * chunks.chunk_samples * sizeof(int16_t);
+	if ((chunks.chunks_nb == 0) || (chunks.chunk_samples == 0) || (chunks.sampling_frequency == 0) ||
+		(chunks.block.size != sizeof(chunks) + chunks.chunks_nb * sizeof(uint64_t) + ((samples_size + 7) & ~7))) {
+		CHECK_ERROR(check, offset, "chunks block of %d bytes : %d chunks of %d samples at %d Hz\n",
+			chunks.block.size, chunks.chunks_nb, chunks.chunk_samples, chunks.sampling_frequency);
+		return;
+	}
+
+	for (i = 0; i < chunks.chunks_nb; i++) {
+		memcpy(&time, p + sizeof(chunks) + i * sizeof(uint64_t), sizeof(time));
+		if (check->chunks && (time <= check->last_time))
+			check->out_of_order++;
+		check->last_time = time;
+		check->chunks++;
+		if (i == 0) {
+			if (check->entries_nb == check->entries_max) {
+				check->entries_max = check->entries_max ? 2 * check->entries_max : 64;
+				check->entries = (struct vd628x_record_index_entry *)realloc(check->entries,
+					check->entries_max * sizeof(struct vd628x_record_index_entry));
+				if (check->entries == NULL) {
+					LOG("Error. Out of memory\n");
+					exit(1);
+				}
+			}
+			check->entries[check->entries_nb].offset = offset;
+			check->entries[check->entries_nb].time = time;
+			check->entries_nb++;
+		}
+	}
+	check->dropped += chunks.dropped;
+
+	if (check->samples_out != NULL)
+		fwrite(p + sizeof(chunks) + chunks.chunks_nb * sizeof(uint64_t), 1, samples_size, check->samples_out);
+
+	if (check->verbose)
+		LOG("%10" PRIu64 " CHNK %3d chunks of %3d samples, %d Hz, spi %d Hz, %d dropped before, first at %" PRIu64 " ns\n",
+			offset, chunks.chunks_nb, chunks.chunk_samples, chunks.sampling_frequency, chunks.spi_frequency,
+			chunks.dropped, check->entries[check->entries_nb - 1].time);
+}
+
+//
+// check_index
+// an index block lists the chunks blocks written since the previous index
+//
+static void check_index(struct rec_check * check, uint64_t offset)
+{
+	struct vd628x_record_index index;
+	struct vd628x_record_index_entry entry;
+	const uint8_t * p = check->data + offset;
+	uint32_t i;
+
+	if (((struct vd628x_record_block *)p)->size < sizeof(index)) {
+		CHECK_ERROR(check, offset, "index block of %d bytes\n", ((struct vd628x_record_block *)p)->size);
+		return;
+	}
+	memcpy(&index, p, sizeof(index));
+	if (index.block.size != sizeof(index) + index.entries_nb * sizeof(entry))
+		CHECK_ERROR(check, offset, "index block of %d bytes for %d entries\n", index.block.size, index.entries_nb);
+	else if (index.entries_nb != check->entries_nb)
+		CHECK_ERROR(check, offset, "index of %d chunks blocks, %d were written\n", index.entries_nb, check->entries_nb);
+	else {
+		for (i = 0; i < index.entries_nb; i++) {
+			memcpy(&entry, p + sizeof(index) + i * sizeof(entry), sizeof(entry));
+			if ((entry.offset != check->entries[i].offset) || (entry.time != check->entries[i].time))
+				CHECK_ERROR(check, offset, "index entry %d : block at %" PRIu64 " time %" PRIu64
+					", expected at %" PRIu64 " time %" PRIu64 "\n", i, entry.offset, entry.time,
+					check->entries[i].offset, check->entries[i].time);
+		}
+	}
+	if (index.previous != check->last_index)
+		CHECK_ERROR(check, offset, "previous index at %" PRIu64 ", expected at %" PRIu64 "\n",
+			index.previous, check->last_index);
+
+	if (check->verbose)
+		LOG("%10" PRIu64 " INDX %3d entries, previous at %" PRIu64 "\n", offset, index.entries_nb, index.previous);
+
+	check->last_index = offset;
+	check->entries_nb = 0;
+}
+
+//
+// check_end
+// the end block is the last one and locates the last index
+//
+static void check_end(struct rec_check * check, uint64_t offset)
+{
+	struct vd628x_record_end end;
+	const uint8_t * p = check->data + offset;
+
+	if (((struct vd628x_record_block *)p)->size != sizeof(end)) {
+		CHECK_ERROR(check, offset, "end block of %d bytes\n", ((struct vd628x_record_block *)p)->size);
+		return;
+	}
+	memcpy(&end, p, sizeof(end));
+	if (end.index != check->last_index)
+		CHECK_ERROR(check, offset, "last index at %" PRIu64 ", expected at %" PRIu64 "\n", end.index, check->last_index);
+	if (check->entries_nb != 0)
+		CHECK_ERROR(check, offset, "%d chunks blocks are not indexed\n", check->entries_nb);
+	if (end.dropped < check->dropped)
+		CHECK_ERROR(check, offset, "%d chunks dropped in total, %" PRIu64 " before the blocks\n", end.dropped, check->dropped);
+	if (offset + sizeof(end) != check->size)
+		CHECK_ERROR(check, offset, "%" PRIu64 " bytes after the end block\n", check->size - offset - sizeof(end));
+
+	if (check->verbose)
+		LOG("%10" PRIu64 " END  last index at %" PRIu64 ", %d chunks dropped\n", offset, end.index, end.dropped);
+
+	check->dropped = end.dropped;
+	check->closed = 1;
+}
+
+//
+// check_file
+// the blocks are walked from the header on
+//
+static void check_file(struct rec_check * check)
+{
+	struct vd628x_record_header header;
+	struct vd628x_record_block block;
+	uint64_t offset;
+
+	if (check->size < sizeof(header)) {
+		CHECK_ERROR(check, 0, "file of %" PRIu64 " bytes\n", check->size);
+		return;
+	}
+	memcpy(&header, check->data, sizeof(header));
+	if (memcmp(header.magic, VD628X_RECORD_MAGIC, sizeof(header.magic)) ||
+		(header.version != VD628X_RECORD_VERSION) || (header.size < sizeof(header)) || (header.size & 7)) {
+		CHECK_ERROR(check, 0, "not a version %d recording\n", VD628X_RECORD_VERSION);
+		return;
+	}
+
+	for (offset = header.size; (offset < check->size) && !check->closed; offset += block.size) {
+		if (check->size - offset < sizeof(block)) {
+			LOG("offset %" PRIu64 " : truncated block header\n", offset);
+			break;
+		}
+		memcpy(&block, check->data + offset, sizeof(block));
+		if ((block.size < sizeof(block)) || (block.size & 7)) {
+			CHECK_ERROR(check, offset, "block of %d bytes\n", block.size);
+			return;
+		}
+		if (block.size > check->size - offset) {
+			LOG("offset %" PRIu64 " : truncated block of %d bytes\n", offset, block.size);
+			break;
+		}
+		check->blocks++;
+
+		if (block.type == VD628X_RECORD_CHUNKS)
+			check_chunks(check, offset);
+		else if (block.type == VD628X_RECORD_INDEX)
+			check_index(check, offset);
+		else if (block.type == VD628X_RECORD_END)
+			check_end(check, offset);
+		else if (check->verbose)
+			LOG("%10" PRIu64 " unknown block %08x of %d bytes skipped\n", offset, block.type, block.size);
+	}
+}
+
+int main(int argc, char * const argv[])
+{
+	struct rec_check check;
+	const char * samples_path = NULL;
+	int opt;
+
+	memset(&check, 0, sizeof(check));
+	while ((opt = getopt(argc, argv, "vo:")) != -1) {
+		if (opt == 'v')
+			check.verbose = 1;
+		else if (opt == 'o')
+			samples_path = optarg;
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (optind != argc - 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	check.data = read_file(argv[optind], &check.size);
+	if (check.data == NULL)
+		return 1;
+	if (samples_path != NULL) {
+		check.samples_out = fopen(samples_path, "wb");
+		if (check.samples_out == NULL) {
+			LOG("Error. Could not create %s\n", samples_path);
+			free(check.data);
+			return 1;
+		}
+	}
+
+	check_file(&check);
+
+	LOG("%d blocks, %" PRIu64 " chunks, %" PRIu64 " chunks dropped, %d chunk times out of order\n",
+		check.blocks, check.chunks, check.dropped, check.out_of_order);
+	if (!check.closed)
+		LOG("the recording was not closed properly : no end block\n");
+	if (check.errors)
+		LOG("%d errors\n", check.errors);
+
+	if (check.samples_out != NULL)
+		fclose(check.samples_out);
+	free(check.entries);
+	free(check.data);
+
+	return check.errors ? 1 : 0;
+}
@@ -0,0 +1,184 @@
+/********************************************************************************
+Copyright (c) 2025, STMicroelectronics - All Rights Reserved
+This file is licensed under open source license ST SLA0103
+********************************************************************************/
+//
+// stand-in producer of the vd628x_spi driver sample ring
+// writes chunks in a shared memory file at the pace of the sampling frequency, so that
+// the consumer side of the ring can be run on a linux host without the sensor
+// -c consumes the ring of the file and checks that no sample is lost
+// the capture of the library consumes it when built with
+// PLATFORM_SPI_DEVICE="ring:/dev/shm/vd628x_ring" : see vd628x_backend_host.c
+//
+// host build :
+// gcc -Imain -Iioctl test/vd628x_ring_producer.c main/vd628x_ring.c -o vd628x_ring_producer -lm
+//
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+
+#include "vd628x_ring.h"
+
+#define LOG printf
+
+#define DEFAULT_PATH "/dev/shm/vd628x_ring"
+#define DEFAULT_SAMPLING_FREQUENCY 2048
+#define DEFAULT_CHUNK_SAMPLES 16
+#define DEFAULT_FLICKER_FREQUENCY 100
+#define RING_SECONDS 2
+#define TEST_PATTERN_MASK 0x3FFF
+
+static void usage(const char * name)
+{
+	LOG("usage : %s [-c] [-t] [-f path] [-s sampling frequency] [-n samples per chunk] [-k flicker frequency] [-d seconds]\n", name);
+	LOG("        -c consumes the ring of path instead of producing it\n");
+	LOG("        -t test pattern : samples count from 0, checked by -c\n");
+}
+
+//
+// produce
+// writes a flicker of flicker_frequency Hz, or the test pattern, for duration seconds
+//
+static int produce(const char * path, uint32_t fs, uint32_t chunk_samples, float flicker_frequency, int test_pattern, int duration)
+{
+	struct vd628x_ring ring;
+	struct timespec next;
+	int16_t * chunk;
+	uint32_t chunks_nb = RING_SECONDS * fs / chunk_samples;
+	uint64_t period_ns = (uint64_t)chunk_samples * 1000000000 / fs;
+	uint32_t n, s, sample = 0;
+
+	chunk = (int16_t *)malloc(chunk_samples * sizeof(int16_t));
+	if ((chunk == NULL) || vd628x_ring_create(&ring, path, chunks_nb, chunk_samples)) {
+		free(chunk);
+		return -1;
+	}
+	LOG("producing %d chunks of %d samples in %s\n", duration * fs / chunk_samples, chunk_samples, path);
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for (n = 0; n < duration * fs / chunk_samples; n++) {
+		for (s = 0; s < chunk_samples; s++, sample++) {
+			if (test_pattern)
+				chunk[s] = (int16_t)(sample & TEST_PATTERN_MASK);
+			else
+				chunk[s] = (int16_t)(8192 + 2048 * sinf(2 * M_PI * flicker_frequency * sample / fs));
+		}
+		vd628x_ring_produce(&ring, chunk);
+
+		// one chunk every chunk_samples samples
+		next.tv_nsec += period_ns;
+		while (next.tv_nsec >= 1000000000) {
+			next.tv_sec++;
+			next.tv_nsec -= 1000000000;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+	}
+
+	LOG("%d chunks dropped because the ring was full\n", vd628x_ring_overruns(&ring));
+	vd628x_ring_unmap(&ring);
+	free(chunk);
+
+	return 0;
+}
+
+//
+// consume
+// reads the chunks of the ring in place for duration seconds, checks the test pattern
+//
+static int consume(const char * path, int test_pattern, int duration)
+{
+	struct vd628x_ring ring;
+	struct vd628x_ring_header header;
+	int16_t * chunk;
+	uint32_t position, chunks = 0, errors = 0, s;
+	int16_t expected = -1;
+	time_t end = time(NULL) + duration;
+	int fd;
+
+	fd = open(path, O_RDWR);
+	if ((fd < 0) || (pread(fd, &header, sizeof(header), 0) != sizeof(header))) {
+		LOG("Error. Could not read %s\n", path);
+		return -1;
+	}
+	if (vd628x_ring_map(&ring, fd, header.data_offset + (size_t)header.chunks_nb * header.chunk_samples * sizeof(int16_t))) {
+		close(fd);
+		return -1;
+	}
+	close(fd);
+
+	chunk = (int16_t *)malloc(header.chunk_samples * sizeof(int16_t));
+	if (chunk == NULL) {
+		vd628x_ring_unmap(&ring);
+		return -1;
+	}
+
+	position = vd628x_ring_consumer(&ring);
+	while (time(NULL) < end) {
+		if (vd628x_ring_available(&ring, position) == 0) {
+			// a file has no poll support : the chunk period is waited
+			usleep(1000);
+			continue;
+		}
+		vd628x_ring_copy(&ring, chunk, position, 1);
+		vd628x_ring_release(&ring, ++position);
+		chunks++;
+
+		for (s = 0; test_pattern && (s < header.chunk_samples); s++) {
+			if ((expected >= 0) && (chunk[s] != expected))
+				errors++;
+			expected = (int16_t)((chunk[s] + 1) & TEST_PATTERN_MASK);
+		}
+	}
+
+	LOG("%d chunks consumed, %d samples out of sequence, %d chunks dropped by the producer\n",
+		chunks, errors, vd628x_ring_overruns(&ring));
+	vd628x_ring_unmap(&ring);
+	free(chunk);
+
+	return errors ? -1 : 0;
+}
+
+int main(int argc, char * const argv[])
+{
+	const char * path = DEFAULT_PATH;
+	uint32_t fs = DEFAULT_SAMPLING_FREQUENCY;
+	uint32_t chunk_samples = DEFAULT_CHUNK_SAMPLES;
+	float flicker_frequency = DEFAULT_FLICKER_FREQUENCY;
+	int consumer = 0, test_pattern = 0, duration = 10;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "ctf:s:n:k:d:")) != -1) {
+		if (opt == 'c')
+			consumer = 1;
+		else if (opt == 't')
+			test_pattern = 1;
+		else if (opt == 'f')
+			path = optarg;
+		else if (opt == 's')
+			fs = atoi(optarg);
+		else if (opt == 'n')
+			chunk_samples = atoi(optarg);
+		else if (opt == 'k')
+			flicker_frequency = atof(optarg);
+		else if (opt == 'd')
+			duration = atoi(optarg);
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if ((fs == 0) || (chunk_samples == 0) || (fs % chunk_samples != 0)) {
+		LOG("Error. The sampling frequency must be a multiple of the chunk samples\n");
+		return 1;
+	}
+
+	if (consumer)
+		return consume(path, test_pattern, duration) ? 1 : 0;
+
+	return produce(path, fs, chunk_samples, flicker_frequency, test_pattern, duration) ? 1 : 0;
+}